@@ -108,10 +108,16 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(res['transactions'], 120)
         assert_equal(res['height'], 120)
         assert_equal(res['txouts'], 120)
-        assert_equal(res['bytes_serialized'], 8520),
+        assert_equal(res['bytes_serialized'], 8457),
         assert_equal(len(res['bestblock']), 64)
         assert_equal(len(res['hash_serialized']), 64)
 
+        res_parallel = node.gettxoutsetinfo("parallel")
+        assert('hash_serialized' not in res_parallel)
+        del res['hash_serialized']
+        assert_equal(res_parallel, res)
+        assert_raises(JSONRPCException, node.gettxoutsetinfo, "incremental")
+
     def _test_getblockheader(self):
         node = self.nodes[0]
 
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Dogecoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+""" SocketEventsBench -- compare the -socketevents backends under many peers
+
+This is a benchmark, not a test, and is not part of the rpc-tests.py lists.
+Run it directly, e.g.
+
+    qa/rpc-tests/socketevents-bench.py --peers=500 --rounds=50
+
+For every requested backend a fresh node is started and --peers loopback
+p2p connections are opened to it. Then:
+
+- all peers ping at once, --rounds times, recording the round trip time of
+  every ping as seen by the mininode network thread
+- the node is left alone with all peers connected for --idle seconds
+
+and the socket handler wakeups (getnettotals "socketwakeups") are reported
+for both phases, together with ping latency percentiles.
+"""
+
+import time
+from threading import Event
+
+from test_framework.mininode import *
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+class BenchNode(NodeConnCB):
+    def __init__(self):
+        NodeConnCB.__init__(self)
+        self.connection = None
+        self.ping_nonce = 0
+        self.ping_sent = 0
+        self.ping_time = None
+        self.got_pong = Event()
+
+    def add_connection(self, conn):
+        self.connection = conn
+
+    def on_pong(self, conn, message):
+        if message.nonce == self.ping_nonce:
+            self.ping_time = time.time() - self.ping_sent
+            self.got_pong.set()
+
+    def send_ping(self, nonce):
+        self.got_pong.clear()
+        self.ping_nonce = nonce
+        self.ping_sent = time.time()
+        self.connection.send_message(msg_ping(nonce=nonce))
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+class SocketEventsBench(BitcoinTestFramework):
+    def __init__(self):
+        super().__init__()
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+
+    def add_options(self, parser):
+        parser.add_option("--peers", dest="peers", default=200, type="int",
+                          help="Number of loopback peers to connect (default: %default)")
+        parser.add_option("--rounds", dest="rounds", default=20, type="int",
+                          help="Number of times every peer pings (default: %default)")
+        parser.add_option("--idle", dest="idle", default=5, type="int",
+                          help="Seconds to measure idle wakeups for (default: %default)")
+        parser.add_option("--socketevents", dest="socketevents", default="select,poll,epoll",
+                          help="Comma-separated backends to compare (default: %default)")
+
+    def setup_network(self):
+        self.nodes = []
+
+    def bench(self, mode):
+        self.nodes = start_nodes(1, self.options.tmpdir,
+                [["-socketevents=%s" % mode, "-maxconnections=%d" % (self.options.peers + 16)]])
+        assert_equal(self.nodes[0].getnetworkinfo()["socketevents"], mode)
+
+        peers = []
+        for i in range(self.options.peers):
+            peer = BenchNode()
+            peer.add_connection(NodeConn('127.0.0.1', p2p_port(0), self.nodes[0], peer))
+            peers.append(peer)
+        NetworkThread().start()
+        for peer in peers:
+            peer.wait_for_verack()
+        wait_until(lambda: self.nodes[0].getconnectioncount() == self.options.peers, timeout=60)
+
+        latencies = []
+        wakeups_start = self.nodes[0].getnettotals()["socketwakeups"]
+        time_start = time.time()
+        for r in range(self.options.rounds):
+            for peer in peers:
+                peer.send_ping(r + 1)
+            for peer in peers:
+                assert(peer.got_pong.wait(timeout=60))
+                latencies.append(peer.ping_time)
+        busy_time = time.time() - time_start
+        busy_wakeups = self.nodes[0].getnettotals()["socketwakeups"] - wakeups_start
+
+        wakeups_start = self.nodes[0].getnettotals()["socketwakeups"]
+        time.sleep(self.options.idle)
+        idle_wakeups = self.nodes[0].getnettotals()["socketwakeups"] - wakeups_start
+
+        for peer in peers:
+            peer.connection.disconnect_node()
+        stop_nodes(self.nodes)
+        self.nodes = []
+        wait_until(lambda: not mininode_socket_map, timeout=60)
+
+        return {
+            "pings/s": len(latencies) / busy_time,
+            "busy wakeups": busy_wakeups,
+            "idle wakeups/s": idle_wakeups / self.options.idle,
+            "p50 ms": percentile(latencies, 50) * 1000,
+            "p90 ms": percentile(latencies, 90) * 1000,
+            "p99 ms": percentile(latencies, 99) * 1000,
+            "max ms": max(latencies) * 1000,
+        }
+
+    def run_test(self):
+        results = []
+        for mode in self.options.socketevents.split(","):
+            results.append((mode, self.bench(mode)))
+
+        print("\n%d peers, %d rounds" % (self.options.peers, self.options.rounds))
+        columns = list(results[0][1].keys())
+        print("%-8s" % "mode" + "".join("%16s" % c for c in columns))
+        for mode, result in results:
+            print("%-8s" % mode + "".join("%16.2f" % result[c] for c in columns))
+
+if __name__ == '__main__':
+    SocketEventsBench().main()
@@ -0,0 +1,189 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "auxpowcache.h"
+
+#include "auxpow.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "init.h"
+#include "memusage.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <utility>
+
+CAuxPowCache auxpowHeaderCache;
+
+CAuxPowCache::CAuxPowCache(size_t nMaxUsageIn) : nMaxUsage(nMaxUsageIn), nUsage(0), nHits(0), nMisses(0)
+{
+}
+
+size_t CAuxPowCache::EntryUsage(const Entry& entry) const
+{
+    // list node (two pointers plus the entry) and hash map node
+    return memusage::MallocUsage(sizeof(Entry) + 2 * sizeof(void*)) +
+           memusage::DynamicUsage(entry.data) +
+           memusage::MallocUsage(sizeof(std::pair<const uint256, EntryList::iterator>) + sizeof(void*));
+}
+
+void CAuxPowCache::EvictToFit()
+{
+    AssertLockHeld(cs);
+    while (nUsage > nMaxUsage && !entries.empty()) {
+        const Entry& entry = entries.back();
+        nUsage -= EntryUsage(entry);
+        mapEntries.erase(entry.hash);
+        entries.pop_back();
+    }
+}
+
+void CAuxPowCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    LOCK(cs);
+    nMaxUsage = nMaxUsageIn;
+    EvictToFit();
+}
+
+void CAuxPowCache::Insert(const uint256& hash, const CAuxPow& auxpow)
+{
+    LOCK(cs);
+    if (nMaxUsage == 0)
+        return;
+    EntryMap::iterator it = mapEntries.find(hash);
+    if (it != mapEntries.end()) {
+        entries.splice(entries.begin(), entries, it->second);
+        return;
+    }
+
+    Entry entry;
+    entry.hash = hash;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << auxpow;
+    entry.data.assign(ss.begin(), ss.end());
+
+    entries.push_front(std::move(entry));
+    mapEntries.insert(std::make_pair(hash, entries.begin()));
+    nUsage += EntryUsage(entries.front());
+    EvictToFit();
+}
+
+boost::shared_ptr<CAuxPow> CAuxPowCache::Lookup(const uint256& hash) const
+{
+    boost::shared_ptr<CAuxPow> auxpow;
+    std::vector<unsigned char> data;
+    {
+        LOCK(cs);
+        EntryMap::const_iterator it = mapEntries.find(hash);
+        if (it == mapEntries.end()) {
+            nMisses++;
+            return auxpow;
+        }
+        nHits++;
+        entries.splice(entries.begin(), entries, it->second);
+        data = it->second->data;
+    }
+
+    // Deserialize outside of the lock
+    auxpow.reset(new CAuxPow());
+    CDataStream ss(data, SER_DISK, CLIENT_VERSION);
+    ss >> *auxpow;
+    return auxpow;
+}
+
+bool CAuxPowCache::Contains(const uint256& hash) const
+{
+    LOCK(cs);
+    return mapEntries.count(hash) > 0;
+}
+
+bool CAuxPowCache::IsFull() const
+{
+    LOCK(cs);
+    if (nMaxUsage == 0)
+        return true;
+    // Assume the next entry is about as large as the average one
+    size_t nAverage = entries.empty() ? 0 : nUsage / entries.size();
+    return nUsage + nAverage > nMaxUsage;
+}
+
+void CAuxPowCache::Clear()
+{
+    LOCK(cs);
+    mapEntries.clear();
+    entries.clear();
+    nUsage = 0;
+}
+
+size_t CAuxPowCache::Size() const
+{
+    LOCK(cs);
+    return entries.size();
+}
+
+size_t CAuxPowCache::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return nUsage + memusage::MallocUsage(sizeof(void*) * mapEntries.bucket_count());
+}
+
+uint64_t CAuxPowCache::Hits() const
+{
+    LOCK(cs);
+    return nHits;
+}
+
+uint64_t CAuxPowCache::Misses() const
+{
+    LOCK(cs);
+    return nMisses;
+}
+
+void WarmAuxPowCache(const CChainParams& chainparams)
+{
+    static const int WARM_BATCH_SIZE = 1000;
+
+    int64_t nStart = GetTimeMillis();
+    int nLoaded = 0;
+    const CBlockIndex* pindex = NULL;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Tip();
+    }
+
+    while (pindex && !auxpowHeaderCache.IsFull() && !ShutdownRequested()) {
+        // Collect a batch of block positions under cs_main, then read them without it.
+        std::vector<std::pair<uint256, CDiskBlockPos> > vToRead;
+        {
+            LOCK(cs_main);
+            for (int i = 0; pindex && i < WARM_BATCH_SIZE; i++, pindex = pindex->pprev) {
+                if (!pindex->IsAuxpow() || !(pindex->nStatus & BLOCK_HAVE_DATA))
+                    continue;
+                if (auxpowHeaderCache.Contains(pindex->GetBlockHash()))
+                    continue;
+                vToRead.push_back(std::make_pair(pindex->GetBlockHash(), pindex->GetBlockPos()));
+            }
+        }
+
+        for (const auto& item : vToRead) {
+            if (auxpowHeaderCache.IsFull() || ShutdownRequested())
+                break;
+            CBlockHeader header;
+            // Pruning may have removed the file in the meantime; just skip those.
+            if (!ReadBlockHeaderFromDisk(header, item.second, chainparams.GetConsensus(0), false))
+                continue;
+            if (header.GetHash() != item.first || !header.auxpow)
+                continue;
+            auxpowHeaderCache.Insert(item.first, *header.auxpow);
+            nLoaded++;
+        }
+    }
+
+    LogPrintf("Loaded %d auxpow headers into cache (%.1fMiB) in %dms\n", nLoaded,
+              auxpowHeaderCache.DynamicMemoryUsage() * (1.0 / 1024 / 1024), GetTimeMillis() - nStart);
+}
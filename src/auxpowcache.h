@@ -0,0 +1,99 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_AUXPOWCACHE_H
+#define BITCOIN_AUXPOWCACHE_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
+class CAuxPow;
+class CChainParams;
+
+/** Default for -auxpowcache, the memory budget for cached auxpow headers (MiB) */
+static const int64_t DEFAULT_AUXPOW_CACHE_SIZE = 64;
+/** Upper bound for -auxpowcache (MiB) */
+static const int64_t MAX_AUXPOW_CACHE_SIZE = 4096;
+
+/**
+ * Bounded in-memory store for the auxpow part of merge-mined block headers.
+ *
+ * CDiskBlockIndex does not persist the auxpow, so without this every call to
+ * CBlockIndex::GetBlockHeader() on a merge-mined block has to read the header
+ * back from the blk*.dat files.  Entries are kept in their serialized form,
+ * which is considerably smaller than a deserialized CAuxPow, and the least
+ * recently used entries are evicted once the memory budget is exceeded.
+ *
+ * All methods are thread-safe.
+ */
+class CAuxPowCache
+{
+private:
+    struct Entry
+    {
+        uint256 hash;
+        std::vector<unsigned char> data;
+    };
+
+    struct EntryHasher
+    {
+        size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+    };
+
+    typedef std::list<Entry> EntryList;
+    typedef boost::unordered_map<uint256, EntryList::iterator, EntryHasher> EntryMap;
+
+    mutable CCriticalSection cs;
+    //! Entries ordered from most to least recently used
+    mutable EntryList entries;
+    EntryMap mapEntries;
+    size_t nMaxUsage;
+    size_t nUsage;
+    mutable uint64_t nHits;
+    mutable uint64_t nMisses;
+
+    size_t EntryUsage(const Entry& entry) const;
+    void EvictToFit();
+
+public:
+    explicit CAuxPowCache(size_t nMaxUsageIn = DEFAULT_AUXPOW_CACHE_SIZE << 20);
+
+    //! Change the memory budget, evicting entries as needed.  Zero disables the cache.
+    void SetMaxUsage(size_t nMaxUsageIn);
+
+    //! Store the auxpow of the block with the given hash.  A no-op if already present.
+    void Insert(const uint256& hash, const CAuxPow& auxpow);
+
+    //! Look up the auxpow for a block.  Returns an empty pointer if it is not cached.
+    boost::shared_ptr<CAuxPow> Lookup(const uint256& hash) const;
+
+    bool Contains(const uint256& hash) const;
+    //! Whether adding another entry would evict an existing one.
+    bool IsFull() const;
+    void Clear();
+
+    size_t Size() const;
+    size_t DynamicMemoryUsage() const;
+    uint64_t Hits() const;
+    uint64_t Misses() const;
+};
+
+/** Global cache of auxpow headers for blocks in mapBlockIndex. */
+extern CAuxPowCache auxpowHeaderCache;
+
+/**
+ * Fill the auxpow header cache from the block files, walking back from the
+ * active tip until the cache is full.  Intended to run after the block index
+ * has been loaded, outside of the init thread.
+ */
+void WarmAuxPowCache(const CChainParams& chainparams);
+
+#endif // BITCOIN_AUXPOWCACHE_H
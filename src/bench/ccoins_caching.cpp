@@ -5,8 +5,11 @@
 #include "bench.h"
 #include "coins.h"
 #include "policy/policy.h"
+#include "random.h"
+#include "utiltime.h"
 #include "wallet/crypter.h"
 
+#include <iostream>
 #include <vector>
 
 // FIXME: Dedup with SetupDummyInputs in test/transaction_tests.cpp.
@@ -35,14 +38,14 @@ SetupDummyInputs(CBasicKeyStore& keystoreRet, CCoinsViewCache& coinsRet)
     dummyTransactions[0].vout[0].scriptPubKey << ToByteVector(key[0].GetPubKey()) << OP_CHECKSIG;
     dummyTransactions[0].vout[1].nValue = 88 * CENT;
     dummyTransactions[0].vout[1].scriptPubKey << ToByteVector(key[1].GetPubKey()) << OP_CHECKSIG;
-    coinsRet.ModifyCoins(dummyTransactions[0].GetHash())->FromTx(dummyTransactions[0], 0);
+    AddCoins(coinsRet, dummyTransactions[0], 0);
 
     dummyTransactions[1].vout.resize(2);
     dummyTransactions[1].vout[0].nValue = 21 * CENT;
     dummyTransactions[1].vout[0].scriptPubKey = GetScriptForDestination(key[2].GetPubKey().GetID());
     dummyTransactions[1].vout[1].nValue = 22 * CENT;
     dummyTransactions[1].vout[1].scriptPubKey = GetScriptForDestination(key[3].GetPubKey().GetID());
-    coinsRet.ModifyCoins(dummyTransactions[1].GetHash())->FromTx(dummyTransactions[1], 0);
+    AddCoins(coinsRet, dummyTransactions[1], 0);
 
     return dummyTransactions;
 }
@@ -85,3 +88,39 @@ static void CCoinsCaching(benchmark::State& state)
 }
 
 BENCHMARK(CCoinsCaching);
+
+// Fill a cache with typical pay-to-pubkey-hash outputs
+static void FillCoinsCache(CCoinsViewCache& coins, const std::vector<COutPoint>& outpoints)
+{
+    CScript script = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    for (const COutPoint& outpoint : outpoints)
+        coins.AddCoin(outpoint, Coin(CTxOut(COIN, script), 1, false), false);
+}
+
+// Filling a cache and flushing it, which for a base without a database
+// only tears it down. Reports the memory used per entry once as well.
+static void CCoinsCacheFlush(benchmark::State& state)
+{
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 100000; i++)
+        outpoints.push_back(COutPoint(GetRandHash(), 0));
+
+    CCoinsView coinsDummy;
+    {
+        CCoinsViewCache coins(&coinsDummy);
+        FillCoinsCache(coins, outpoints);
+        double nMiB = coins.DynamicMemoryUsage() / (1024.0 * 1024.0);
+        int64_t nStart = GetTimeMicros();
+        coins.Flush();
+        std::cout << "#CCoinsCacheFlush entries per MiB: " << (int64_t)(outpoints.size() / nMiB)
+                  << ", flush of " << outpoints.size() << " entries: " << (GetTimeMicros() - nStart) * 0.001 << "ms\n";
+    }
+
+    while (state.KeepRunning()) {
+        CCoinsViewCache coins(&coinsDummy);
+        FillCoinsCache(coins, outpoints);
+        coins.Flush();
+    }
+}
+
+BENCHMARK(CCoinsCacheFlush);
@@ -0,0 +1,102 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "compat.h"
+#include "util.h"
+
+#ifndef WIN32
+#include <sys/stat.h>
+#endif
+
+CBlockFileMapCache blockFileMaps(DEFAULT_BLOCK_FILE_MAPS);
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(pchData), nSize);
+#endif
+}
+
+std::shared_ptr<const CMappedFile> CMappedFile::Open(const std::string& strPath)
+{
+#ifndef WIN32
+    int fd = open(strPath.c_str(), O_RDONLY);
+    if (fd == -1)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+    size_t nSize = st.st_size;
+    void* p = mmap(NULL, nSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        LogPrint("db", "%s: mmap of %s failed: %s\n", __func__, strPath, strerror(errno));
+        return NULL;
+    }
+    return std::shared_ptr<const CMappedFile>(new CMappedFile(static_cast<const unsigned char*>(p), nSize));
+#else
+    return NULL;
+#endif
+}
+
+void CBlockFileMapCache::Trim()
+{
+    while (listMaps.size() > nMaxMaps) {
+        mapFiles.erase(listMaps.back().first);
+        listMaps.pop_back();
+    }
+}
+
+void CBlockFileMapCache::SetMaxMaps(size_t nMaxMapsIn)
+{
+    LOCK(cs);
+    nMaxMaps = nMaxMapsIn;
+    Trim();
+}
+
+std::shared_ptr<const CMappedFile> CBlockFileMapCache::Get(int nFile, const std::string& strPath)
+{
+    LOCK(cs);
+    if (nMaxMaps == 0)
+        return NULL;
+    std::map<int, MapList::iterator>::iterator it = mapFiles.find(nFile);
+    if (it != mapFiles.end()) {
+        listMaps.splice(listMaps.begin(), listMaps, it->second);
+        return it->second->second;
+    }
+    std::shared_ptr<const CMappedFile> mapped = CMappedFile::Open(strPath);
+    if (!mapped)
+        return NULL;
+    listMaps.push_front(std::make_pair(nFile, mapped));
+    mapFiles[nFile] = listMaps.begin();
+    Trim();
+    return mapped;
+}
+
+void CBlockFileMapCache::Erase(int nFile)
+{
+    LOCK(cs);
+    std::map<int, MapList::iterator>::iterator it = mapFiles.find(nFile);
+    if (it == mapFiles.end())
+        return;
+    listMaps.erase(it->second);
+    mapFiles.erase(it);
+}
+
+void CBlockFileMapCache::Clear()
+{
+    LOCK(cs);
+    listMaps.clear();
+    mapFiles.clear();
+}
+
+size_t CBlockFileMapCache::Size() const
+{
+    LOCK(cs);
+    return listMaps.size();
+}
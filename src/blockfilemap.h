@@ -0,0 +1,80 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include "sync.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <stddef.h>
+#include <string>
+
+//! -blockfilemaps default: block files kept mapped (none on 32-bit, where address space is scarce)
+static const int DEFAULT_BLOCK_FILE_MAPS = sizeof(void*) >= 8 ? 32 : 0;
+
+/** A whole file mapped read-only into memory, unmapped on destruction. */
+class CMappedFile
+{
+private:
+    const unsigned char* pchData;
+    size_t nSize;
+
+    CMappedFile(const unsigned char* pchDataIn, size_t nSizeIn) : pchData(pchDataIn), nSize(nSizeIn) {}
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+public:
+    ~CMappedFile();
+
+    //! Map the file at strPath; NULL if it cannot be mapped (or mapping is not supported)
+    static std::shared_ptr<const CMappedFile> Open(const std::string& strPath);
+
+    const unsigned char* data() const { return pchData; }
+    size_t size() const { return nSize; }
+};
+
+/**
+ * Least recently used set of mapped block files, so that blocks that are
+ * read over and over (served to peers, rescanned) are deserialized straight
+ * from the page cache instead of being opened, seeked and read each time.
+ *
+ * Only files that are no longer appended to may be mapped, as a mapping
+ * covers the file as it was when it was made. Mappings are shared, so a
+ * reader keeps using one safely after it is evicted or erased.
+ */
+class CBlockFileMapCache
+{
+private:
+    typedef std::list<std::pair<int, std::shared_ptr<const CMappedFile> > > MapList;
+
+    mutable CCriticalSection cs;
+    size_t nMaxMaps;
+    //! Most recently used first
+    MapList listMaps;
+    std::map<int, MapList::iterator> mapFiles;
+
+    void Trim();
+
+public:
+    explicit CBlockFileMapCache(size_t nMaxMapsIn) : nMaxMaps(nMaxMapsIn) {}
+
+    void SetMaxMaps(size_t nMaxMapsIn);
+
+    //! Mapping of block file nFile at strPath, mapping it on first use; NULL if it cannot be mapped
+    std::shared_ptr<const CMappedFile> Get(int nFile, const std::string& strPath);
+
+    //! Drop the mapping of nFile, for instance before the file is deleted
+    void Erase(int nFile);
+    void Clear();
+
+    size_t Size() const;
+};
+
+/** Global set of mapped block files, used by ReadBlockFromDisk. */
+extern CBlockFileMapCache blockFileMaps;
+
+#endif // BITCOIN_BLOCKFILEMAP_H
@@ -0,0 +1,103 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKSTATS_H
+#define BITCOIN_BLOCKSTATS_H
+
+#include "amount.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+
+static constexpr int NUM_GETBLOCKSTATS_PERCENTILES = 5;
+
+/** Used by getblockstats to get feerates at different percentiles by weight  */
+void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight);
+
+/**
+ * Statistics of a block as reported by getblockstats. This is also the
+ * fixed-width record stored per height by -blockstatsindex, so that
+ * getblockstats does not need to read the block and its undo data again.
+ */
+class CBlockStats
+{
+public:
+    uint256 hashBlock;
+    uint256 hashPrevBlock;
+    int32_t nHeight;
+    int64_t nTime;
+    int64_t nMedianTime;
+
+    int64_t nTxs;
+    int64_t nIns;
+    int64_t nOuts;
+    CAmount nTotalOut;
+    CAmount nTotalFee;
+    CAmount nMinFee;
+    CAmount nMaxFee;
+    CAmount nMedianFee;
+    CAmount nMinFeeRate;
+    CAmount nMaxFeeRate;
+    CAmount vFeeRatePercentiles[NUM_GETBLOCKSTATS_PERCENTILES];
+    int64_t nTotalSize;
+    int64_t nMinTxSize;
+    int64_t nMaxTxSize;
+    int64_t nMedianTxSize;
+    int64_t nTotalWeight;
+    int64_t nSwTxs;
+    int64_t nSwTotalSize;
+    int64_t nSwTotalWeight;
+    int64_t nUtxoSizeInc;
+
+    CBlockStats()
+    {
+        SetNull();
+    }
+
+    void SetNull();
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashBlock);
+        READWRITE(hashPrevBlock);
+        READWRITE(nHeight);
+        READWRITE(nTime);
+        READWRITE(nMedianTime);
+        READWRITE(nTxs);
+        READWRITE(nIns);
+        READWRITE(nOuts);
+        READWRITE(nTotalOut);
+        READWRITE(nTotalFee);
+        READWRITE(nMinFee);
+        READWRITE(nMaxFee);
+        READWRITE(nMedianFee);
+        READWRITE(nMinFeeRate);
+        READWRITE(nMaxFeeRate);
+        for (int i = 0; i < NUM_GETBLOCKSTATS_PERCENTILES; i++)
+            READWRITE(vFeeRatePercentiles[i]);
+        READWRITE(nTotalSize);
+        READWRITE(nMinTxSize);
+        READWRITE(nMaxTxSize);
+        READWRITE(nMedianTxSize);
+        READWRITE(nTotalWeight);
+        READWRITE(nSwTxs);
+        READWRITE(nSwTotalSize);
+        READWRITE(nSwTotalWeight);
+        READWRITE(nUtxoSizeInc);
+    }
+};
+
+/** Calculate the statistics of a connected block from the block and its undo data */
+void ComputeBlockStats(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo, CBlockStats& stats);
+
+#endif // BITCOIN_BLOCKSTATS_H
@@ -5,6 +5,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain.h"
+
+#include "auxpowcache.h"
 #include "validation.h"
 
 using namespace std;
@@ -18,12 +20,18 @@ CBlockHeader CBlockIndex::GetBlockHeader(const Consensus::Params& consensusParam
     block.nVersion       = nVersion;
 
     /* The CBlockIndex object's block header is missing the auxpow.
-       So if this is an auxpow block, read it from disk instead.  We only
-       have to read the actual *header*, not the full block.  */
+       So if this is an auxpow block, take it from the in-memory cache
+       or, failing that, read it from disk instead.  We only have to read
+       the actual *header*, not the full block.  Cached entries were already
+       validated when the header was accepted or first read back.  */
     if (block.IsAuxpow())
     {
-        ReadBlockHeaderFromDisk(block, this, consensusParams, fCheckPOW);
-        return block;
+        block.auxpow = auxpowHeaderCache.Lookup(GetBlockHash());
+        if (!block.auxpow)
+        {
+            ReadBlockHeaderFromDisk(block, this, consensusParams, fCheckPOW);
+            return block;
+        }
     }
 
     if (pprev)
@@ -83,6 +83,14 @@ typedef u_int SOCKET;
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
+// poll() should work with the current usage, but WSAPoll is broken on WIN32
+// and poll() misbehaves on some socket types on __APPLE__, so only use it
+// (and epoll) where it is known to be reliable.
+#if defined(__linux__)
+#define USE_POLL
+#define USE_EPOLL
+#endif
+
 bool static inline IsSelectableSocket(SOCKET s) {
 #ifdef WIN32
     return true;
@@ -0,0 +1,93 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/*
+ * Multi-buffer scrypt(1024, 1, 1) core hashing eight independent inputs at
+ * once, one per 32-bit lane of the AVX2 registers.  Only the memory-hard
+ * ROMix part lives here, PBKDF2 is done per input by
+ * scrypt_1024_1_1_256_multi(), so this is the only code built with -mavx2.
+ */
+
+#include "crypto/scrypt.h"
+
+#include <stdint.h>
+
+#include <immintrin.h>
+
+#define ROTL_AVX2(a, b) _mm256_or_si256(_mm256_slli_epi32((a), (b)), _mm256_srli_epi32((a), 32 - (b)))
+#define STEP_AVX2(x, a, b, c, r) x[a] = _mm256_xor_si256(x[a], ROTL_AVX2(_mm256_add_epi32(x[b], x[c]), r))
+
+static inline void xor_salsa8_avx2(__m256i B[16], const __m256i Bx[16])
+{
+	__m256i x[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		x[i] = B[i] = _mm256_xor_si256(B[i], Bx[i]);
+
+	for (i = 0; i < 8; i += 2) {
+		/* Operate on columns. */
+		STEP_AVX2(x,  4,  0, 12,  7);  STEP_AVX2(x,  9,  5,  1,  7);
+		STEP_AVX2(x, 14, 10,  6,  7);  STEP_AVX2(x,  3, 15, 11,  7);
+
+		STEP_AVX2(x,  8,  4,  0,  9);  STEP_AVX2(x, 13,  9,  5,  9);
+		STEP_AVX2(x,  2, 14, 10,  9);  STEP_AVX2(x,  7,  3, 15,  9);
+
+		STEP_AVX2(x, 12,  8,  4, 13);  STEP_AVX2(x,  1, 13,  9, 13);
+		STEP_AVX2(x,  6,  2, 14, 13);  STEP_AVX2(x, 11,  7,  3, 13);
+
+		STEP_AVX2(x,  0, 12,  8, 18);  STEP_AVX2(x,  5,  1, 13, 18);
+		STEP_AVX2(x, 10,  6,  2, 18);  STEP_AVX2(x, 15, 11,  7, 18);
+
+		/* Operate on rows. */
+		STEP_AVX2(x,  1,  0,  3,  7);  STEP_AVX2(x,  6,  5,  4,  7);
+		STEP_AVX2(x, 11, 10,  9,  7);  STEP_AVX2(x, 12, 15, 14,  7);
+
+		STEP_AVX2(x,  2,  1,  0,  9);  STEP_AVX2(x,  7,  6,  5,  9);
+		STEP_AVX2(x,  8, 11, 10,  9);  STEP_AVX2(x, 13, 12, 15,  9);
+
+		STEP_AVX2(x,  3,  2,  1, 13);  STEP_AVX2(x,  4,  7,  6, 13);
+		STEP_AVX2(x,  9,  8, 11, 13);  STEP_AVX2(x, 14, 13, 12, 13);
+
+		STEP_AVX2(x,  0,  3,  2, 18);  STEP_AVX2(x,  5,  4,  7, 18);
+		STEP_AVX2(x, 10,  9,  8, 18);  STEP_AVX2(x, 15, 14, 13, 18);
+	}
+
+	for (i = 0; i < 16; i++)
+		B[i] = _mm256_add_epi32(B[i], x[i]);
+}
+
+void scrypt_romix_x8_avx2(uint32_t *X, char *scratchpad)
+{
+	__m256i Y[32];
+	__m256i *V;
+	uint32_t i, k;
+
+	V = (__m256i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+	for (k = 0; k < 32; k++)
+		Y[k] = _mm256_loadu_si256((const __m256i *)&X[k * 8]);
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			V[i * 32 + k] = Y[k];
+		xor_salsa8_avx2(&Y[0], &Y[16]);
+		xor_salsa8_avx2(&Y[16], &Y[0]);
+	}
+
+	/* Each lane reads its own row of V: word k of row j for lane l is at
+	   32-bit offset (j * 32 + k) * 8 + l. */
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i mask = _mm256_set1_epi32(1023);
+	for (i = 0; i < 1024; i++) {
+		const __m256i idx = _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(Y[16], mask), 8), lanes);
+		for (k = 0; k < 32; k++)
+			Y[k] = _mm256_xor_si256(Y[k], _mm256_i32gather_epi32((const int *)&V[k], idx, 4));
+		xor_salsa8_avx2(&Y[0], &Y[16]);
+		xor_salsa8_avx2(&Y[16], &Y[0]);
+	}
+
+	for (k = 0; k < 32; k++)
+		_mm256_storeu_si256((__m256i *)&X[k * 8], Y[k]);
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/*
+ * Multi-buffer scrypt(1024, 1, 1) core hashing sixteen independent inputs at
+ * once, one per 32-bit lane of the AVX-512 registers.  Only the memory-hard
+ * ROMix part lives here, PBKDF2 is done per input by
+ * scrypt_1024_1_1_256_multi(), so this is the only code built with -mavx512f.
+ */
+
+#include "crypto/scrypt.h"
+
+#include <stdint.h>
+
+#include <immintrin.h>
+
+#define ROTL_AVX512(a, b) _mm512_rol_epi32((a), (b))
+#define STEP_AVX512(x, a, b, c, r) x[a] = _mm512_xor_si512(x[a], ROTL_AVX512(_mm512_add_epi32(x[b], x[c]), r))
+
+static inline void xor_salsa8_avx512(__m512i B[16], const __m512i Bx[16])
+{
+	__m512i x[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		x[i] = B[i] = _mm512_xor_si512(B[i], Bx[i]);
+
+	for (i = 0; i < 8; i += 2) {
+		/* Operate on columns. */
+		STEP_AVX512(x,  4,  0, 12,  7);  STEP_AVX512(x,  9,  5,  1,  7);
+		STEP_AVX512(x, 14, 10,  6,  7);  STEP_AVX512(x,  3, 15, 11,  7);
+
+		STEP_AVX512(x,  8,  4,  0,  9);  STEP_AVX512(x, 13,  9,  5,  9);
+		STEP_AVX512(x,  2, 14, 10,  9);  STEP_AVX512(x,  7,  3, 15,  9);
+
+		STEP_AVX512(x, 12,  8,  4, 13);  STEP_AVX512(x,  1, 13,  9, 13);
+		STEP_AVX512(x,  6,  2, 14, 13);  STEP_AVX512(x, 11,  7,  3, 13);
+
+		STEP_AVX512(x,  0, 12,  8, 18);  STEP_AVX512(x,  5,  1, 13, 18);
+		STEP_AVX512(x, 10,  6,  2, 18);  STEP_AVX512(x, 15, 11,  7, 18);
+
+		/* Operate on rows. */
+		STEP_AVX512(x,  1,  0,  3,  7);  STEP_AVX512(x,  6,  5,  4,  7);
+		STEP_AVX512(x, 11, 10,  9,  7);  STEP_AVX512(x, 12, 15, 14,  7);
+
+		STEP_AVX512(x,  2,  1,  0,  9);  STEP_AVX512(x,  7,  6,  5,  9);
+		STEP_AVX512(x,  8, 11, 10,  9);  STEP_AVX512(x, 13, 12, 15,  9);
+
+		STEP_AVX512(x,  3,  2,  1, 13);  STEP_AVX512(x,  4,  7,  6, 13);
+		STEP_AVX512(x,  9,  8, 11, 13);  STEP_AVX512(x, 14, 13, 12, 13);
+
+		STEP_AVX512(x,  0,  3,  2, 18);  STEP_AVX512(x,  5,  4,  7, 18);
+		STEP_AVX512(x, 10,  9,  8, 18);  STEP_AVX512(x, 15, 14, 13, 18);
+	}
+
+	for (i = 0; i < 16; i++)
+		B[i] = _mm512_add_epi32(B[i], x[i]);
+}
+
+void scrypt_romix_x16_avx512(uint32_t *X, char *scratchpad)
+{
+	__m512i Y[32];
+	__m512i *V;
+	uint32_t i, k;
+
+	V = (__m512i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+	for (k = 0; k < 32; k++)
+		Y[k] = _mm512_loadu_si512((const __m512i *)&X[k * 16]);
+
+	for (i = 0; i < 1024; i++) {
+		for (k = 0; k < 32; k++)
+			V[i * 32 + k] = Y[k];
+		xor_salsa8_avx512(&Y[0], &Y[16]);
+		xor_salsa8_avx512(&Y[16], &Y[0]);
+	}
+
+	/* Each lane reads its own row of V: word k of row j for lane l is at
+	   32-bit offset (j * 32 + k) * 16 + l. */
+	const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m512i mask = _mm512_set1_epi32(1023);
+	for (i = 0; i < 1024; i++) {
+		const __m512i idx = _mm512_add_epi32(_mm512_slli_epi32(_mm512_and_si512(Y[16], mask), 9), lanes);
+		for (k = 0; k < 32; k++)
+			Y[k] = _mm512_xor_si512(Y[k], _mm512_i32gather_epi32(idx, (const int *)&V[k], 4));
+		xor_salsa8_avx512(&Y[0], &Y[16]);
+		xor_salsa8_avx512(&Y[16], &Y[0]);
+	}
+
+	for (k = 0; k < 32; k++)
+		_mm512_storeu_si512((__m512i *)&X[k * 16], Y[k]);
+}
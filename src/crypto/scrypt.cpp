@@ -29,11 +29,15 @@
 
 #include "crypto/scrypt.h"
 #include "crypto/hmac_sha256.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <openssl/sha.h>
 
+#include <algorithm>
+#include <vector>
+
 #if defined(USE_SSE2) && !defined(USE_SSE2_ALWAYS)
 #ifdef _MSC_VER
 // MSVC 64bit is unable to use inline asm
@@ -44,6 +48,13 @@
 #endif
 #endif
 
+// The multi-buffer kernels are left out of libdogecoinconsensus, which does
+// not link against the libraries holding them.
+#if (defined(ENABLE_AVX2) || defined(ENABLE_AVX512F)) && !defined(BUILD_BITCOIN_INTERNAL)
+#define USE_SCRYPT_MULTI 1
+#include <cpuid.h>
+#endif
+
 #ifndef __FreeBSD__
 static inline uint32_t be32dec(const void *pp)
 {
@@ -260,3 +271,104 @@ void scrypt_1024_1_1_256(const char *input, char *output)
     memset(scratchpad, 0, sizeof(scratchpad));
     scrypt_1024_1_1_256_sp(input, output, scratchpad);
 }
+
+#if defined(USE_SCRYPT_MULTI)
+static inline uint64_t xgetbv()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return ((uint64_t)d << 32) | a;
+}
+#endif
+
+struct scrypt_multi_kernel {
+    const char *name;
+    size_t lanes;
+    void (*romix)(uint32_t *X, char *scratchpad);
+};
+
+// Selected kernels, from the widest to the narrowest
+static scrypt_multi_kernel scrypt_multi_kernels[2];
+static size_t scrypt_multi_kernel_count = 0;
+
+const char *scrypt_detect_multi(size_t max_lanes)
+{
+    scrypt_multi_kernel_count = 0;
+#if defined(USE_SCRYPT_MULTI)
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    bool have_avx2 = false, have_avx512f = false;
+    if (__get_cpuid_max(0, NULL) >= 7) {
+        __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+        // The OS has to save the wider registers on context switches
+        const bool have_osxsave = (ecx >> 27) & 1;
+        const uint64_t xcr0 = have_osxsave ? xgetbv() : 0;
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = ((ebx >> 5) & 1) && (xcr0 & 0x6) == 0x6;
+        have_avx512f = ((ebx >> 16) & 1) && (xcr0 & 0xe6) == 0xe6;
+    }
+#if defined(ENABLE_AVX512F)
+    if (have_avx512f && max_lanes >= 16) {
+        scrypt_multi_kernel kernel = {"avx512", 16, &scrypt_romix_x16_avx512};
+        scrypt_multi_kernels[scrypt_multi_kernel_count++] = kernel;
+    }
+#endif
+#if defined(ENABLE_AVX2)
+    if (have_avx2 && max_lanes >= 8) {
+        scrypt_multi_kernel kernel = {"avx2", 8, &scrypt_romix_x8_avx2};
+        scrypt_multi_kernels[scrypt_multi_kernel_count++] = kernel;
+    }
+#endif
+#endif // USE_SCRYPT_MULTI
+    if (scrypt_multi_kernel_count == 0)
+        return "single";
+    return scrypt_multi_kernels[0].name;
+}
+
+void scrypt_1024_1_1_256_multi(const char *inputs[], char *outputs[], size_t n)
+{
+    thread_local std::vector<char> scratchpad;
+    uint32_t X[32 * SCRYPT_MAX_LANES];
+    uint8_t B[128];
+    size_t offset = 0;
+
+    while (offset < n) {
+        const size_t remaining = n - offset;
+        // Use the narrowest kernel that takes all remaining inputs at once,
+        // or the widest one if none does.
+        const scrypt_multi_kernel *kernel = NULL;
+        for (size_t i = 0; i < scrypt_multi_kernel_count; i++) {
+            if (i == 0 || scrypt_multi_kernels[i].lanes >= remaining)
+                kernel = &scrypt_multi_kernels[i];
+        }
+        if (kernel == NULL || remaining == 1) {
+            scrypt_1024_1_1_256(inputs[offset], outputs[offset]);
+            offset++;
+            continue;
+        }
+
+        const size_t lanes = kernel->lanes;
+        const size_t count = std::min(lanes, remaining);
+        for (size_t l = 0; l < count; l++) {
+            const uint8_t *input = (const uint8_t *)inputs[offset + l];
+            PBKDF2_SHA256(input, 80, input, 80, 1, B, 128);
+            for (size_t k = 0; k < 32; k++)
+                X[k * lanes + l] = le32dec(&B[4 * k]);
+        }
+        // Unused lanes of a partial group just repeat the last input
+        for (size_t l = count; l < lanes; l++) {
+            for (size_t k = 0; k < 32; k++)
+                X[k * lanes + l] = X[k * lanes + count - 1];
+        }
+
+        scratchpad.resize(lanes * 131072 + 63);
+        kernel->romix(X, scratchpad.data());
+
+        for (size_t l = 0; l < count; l++) {
+            const uint8_t *input = (const uint8_t *)inputs[offset + l];
+            for (size_t k = 0; k < 32; k++)
+                le32enc(&B[4 * k], X[k * lanes + l]);
+            PBKDF2_SHA256(input, 80, B, 128, 1, (uint8_t *)outputs[offset + l], 32);
+        }
+        offset += count;
+    }
+}
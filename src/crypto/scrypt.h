@@ -1,9 +1,16 @@
 #ifndef SCRYPT_H
 #define SCRYPT_H
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
 #include <stdlib.h>
 #include <stdint.h>
 
 static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
+/** Most inputs hashed at once by scrypt_1024_1_1_256_multi() */
+static const size_t SCRYPT_MAX_LANES = 16;
 
 void scrypt_1024_1_1_256(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
@@ -23,6 +30,25 @@ extern void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output,
 #define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_generic((input), (output), (scratchpad))
 #endif
 
+/**
+ * Hash n independent 80-byte inputs, writing 32 bytes to each of outputs.
+ * Groups of inputs are hashed together in the SIMD lanes of the kernel picked
+ * by scrypt_detect_multi(); without one this hashes them one by one.
+ */
+void scrypt_1024_1_1_256_multi(const char *inputs[], char *outputs[], size_t n);
+/**
+ * Select the widest multi-buffer kernel supported by the CPU and the build,
+ * using at most max_lanes lanes.  Returns the name of the selected kernel.
+ */
+const char *scrypt_detect_multi(size_t max_lanes = SCRYPT_MAX_LANES);
+
+#if defined(ENABLE_AVX2)
+void scrypt_romix_x8_avx2(uint32_t *X, char *scratchpad);
+#endif
+#if defined(ENABLE_AVX512F)
+void scrypt_romix_x16_avx512(uint32_t *X, char *scratchpad);
+#endif
+
 void
 PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
     size_t saltlen, uint64_t c, uint8_t *buf, size_t dkLen);
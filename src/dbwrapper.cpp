@@ -7,6 +7,8 @@
 #include "util.h"
 #include "random.h"
 
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
 #include <boost/filesystem.hpp>
 
 #include <leveldb/cache.h>
@@ -15,14 +17,71 @@
 #include <memenv.h>
 #include <stdint.h>
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+std::string CDBOptions::ToString() const
+{
+    return strprintf("compression=%s,maxopenfiles=%d,maxfilesize=%d,bloombits=%d",
+        fCompression ? "snappy" : "none", nMaxOpenFiles, nMaxFileSize, nBloomBits);
+}
+
+bool ParseDBOptions(const std::string& str, CDBOptions& opts, std::string& strError)
+{
+    std::vector<std::string> vPairs;
+    boost::split(vPairs, str, boost::is_any_of(","));
+    for (const std::string& strPair : vPairs) {
+        if (strPair.empty())
+            continue;
+        size_t nPos = strPair.find('=');
+        if (nPos == std::string::npos) {
+            strError = strprintf("expected key=value, got '%s'", strPair);
+            return false;
+        }
+        const std::string strKey = strPair.substr(0, nPos);
+        const std::string strValue = strPair.substr(nPos + 1);
+        int32_t n;
+        if (strKey == "compression") {
+            if (strValue == "none")
+                opts.fCompression = false;
+            else if (strValue == "snappy")
+                opts.fCompression = true;
+            else {
+                strError = strprintf("unknown compression '%s'", strValue);
+                return false;
+            }
+        } else if (strKey == "maxopenfiles") {
+            if (!ParseInt32(strValue, &n) || n < 16) {
+                strError = strprintf("maxopenfiles must be at least 16, got '%s'", strValue);
+                return false;
+            }
+            opts.nMaxOpenFiles = n;
+        } else if (strKey == "maxfilesize") {
+            if (!ParseInt32(strValue, &n) || n < 1 || n > 1024) {
+                strError = strprintf("maxfilesize must be 1 to 1024 MiB, got '%s'", strValue);
+                return false;
+            }
+            opts.nMaxFileSize = n;
+        } else if (strKey == "bloombits") {
+            if (!ParseInt32(strValue, &n) || n < 0 || n > 64) {
+                strError = strprintf("bloombits must be 0 to 64, got '%s'", strValue);
+                return false;
+            }
+            opts.nBloomBits = n;
+        } else {
+            strError = strprintf("unknown option '%s'", strKey);
+            return false;
+        }
+    }
+    return true;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBOptions& dbopts)
 {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
     options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.filter_policy = dbopts.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(dbopts.nBloomBits) : NULL;
+    options.compression = dbopts.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = dbopts.nMaxOpenFiles;
+    options.max_file_size = (size_t)dbopts.nMaxFileSize << 20;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -31,14 +90,14 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const CDBOptions& dbopts) : dboptions(dbopts)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, dboptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -50,7 +109,7 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
             dbwrapper_private::HandleError(result);
         }
         TryCreateDirectory(path);
-        LogPrintf("Opening LevelDB in %s\n", path.string());
+        LogPrintf("Opening LevelDB in %s (%s)\n", path.string(), dboptions.ToString());
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
@@ -26,6 +26,37 @@ public:
     dbwrapper_error(const std::string& msg) : std::runtime_error(msg) {}
 };
 
+//! Default LevelDB table cache size, in files
+static const int DEFAULT_DB_MAX_OPEN_FILES = 64;
+//! Default target size of a LevelDB table file (MiB)
+static const int DEFAULT_DB_MAX_FILE_SIZE = 2;
+//! Default bloom filter size (bits per key)
+static const int DEFAULT_DB_BLOOM_BITS = 10;
+
+/**
+ * LevelDB tuning of a single database. Set from a comma-separated list of
+ * key=value pairs by ParseDBOptions:
+ *
+ *   compression=none|snappy  compress table blocks
+ *   maxopenfiles=<n>         table files kept open (table cache size)
+ *   maxfilesize=<n>          target size of a table file (MiB)
+ *   bloombits=<n>            bloom filter bits per key, 0 to disable
+ */
+struct CDBOptions
+{
+    bool fCompression;
+    int nMaxOpenFiles;
+    int nMaxFileSize;
+    int nBloomBits;
+
+    CDBOptions() : fCompression(false), nMaxOpenFiles(DEFAULT_DB_MAX_OPEN_FILES), nMaxFileSize(DEFAULT_DB_MAX_FILE_SIZE), nBloomBits(DEFAULT_DB_BLOOM_BITS) {}
+
+    std::string ToString() const;
+};
+
+/** Parse a CDBOptions list on top of the values already in opts. */
+bool ParseDBOptions(const std::string& str, CDBOptions& opts, std::string& strError);
+
 class CDBWrapper;
 
 /** These should be considered an implementation detail of the specific database.
@@ -56,11 +87,19 @@ private:
     CDataStream ssKey;
     CDataStream ssValue;
 
+    size_t size_estimate;
+
 public:
     /**
      * @param[in] _parent   CDBWrapper that this batch is to be submitted to
      */
-    CDBBatch(const CDBWrapper &_parent) : parent(_parent), ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION) { };
+    CDBBatch(const CDBWrapper &_parent) : parent(_parent), ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION), size_estimate(0) { };
+
+    void Clear()
+    {
+        batch.Clear();
+        size_estimate = 0;
+    }
 
     template <typename K, typename V>
     void Write(const K& key, const V& value)
@@ -75,6 +114,14 @@ public:
         leveldb::Slice slValue(ssValue.data(), ssValue.size());
 
         batch.Put(slKey, slValue);
+        // LevelDB serializes writes as:
+        // - byte: header
+        // - varint: key length (1 byte up to 127B, 2 bytes up to 16383B, ...)
+        // - byte[]: key
+        // - varint: value length
+        // - byte[]: value
+        // The formula below assumes the key and value are both less than 16k.
+        size_estimate += 3 + (slKey.size() > 127) + slKey.size() + (slValue.size() > 127) + slValue.size();
         ssKey.clear();
         ssValue.clear();
     }
@@ -87,8 +134,16 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         batch.Delete(slKey);
+        // LevelDB serializes erases as:
+        // - byte: header
+        // - varint: key length
+        // - byte[]: key
+        // The formula below assumes the key is less than 16kB.
+        size_estimate += 2 + (slKey.size() > 127) + slKey.size();
         ssKey.clear();
     }
+
+    size_t SizeEstimate() const { return size_estimate; }
 };
 
 class CDBIterator
@@ -164,6 +219,9 @@ private:
     //! database options used
     leveldb::Options options;
 
+    //! tuning the database options were built from
+    CDBOptions dboptions;
+
     //! options used when reading from the database
     leveldb::ReadOptions readoptions;
 
@@ -198,8 +256,9 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] dbopts      Compression, table file and bloom filter tuning.
      */
-    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const CDBOptions& dbopts = CDBOptions());
     ~CDBWrapper();
 
     template <typename K, typename V>
@@ -282,10 +341,54 @@ public:
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
 
+    /**
+     * Return an iterator that sees the database as it was when snapshot was
+     * taken. The snapshot must outlive the iterator.
+     */
+    CDBIterator *NewIterator(const leveldb::Snapshot *snapshot)
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot;
+        return new CDBIterator(*this, pdb->NewIterator(options));
+    }
+
+    //! Take a consistent read-only snapshot; release it with ReleaseSnapshot()
+    const leveldb::Snapshot *GetSnapshot() const
+    {
+        return pdb->GetSnapshot();
+    }
+
+    void ReleaseSnapshot(const leveldb::Snapshot *snapshot) const
+    {
+        pdb->ReleaseSnapshot(snapshot);
+    }
+
     /**
      * Return true if the database managed by this class contains no entries.
      */
     bool IsEmpty();
+
+    const CDBOptions& GetDBOptions() const { return dboptions; }
+
+    //! Read a LevelDB property such as "leveldb.stats"; false if unknown
+    bool GetProperty(const std::string& name, std::string& value) const
+    {
+        return pdb->GetProperty(name, &value);
+    }
+
+    //! Compact the keys between key_begin and key_end (inclusive)
+    template<typename K>
+    void CompactRange(const K& key_begin, const K& key_end) const
+    {
+        CDataStream ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
+        ssKey1.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey2.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey1 << key_begin;
+        ssKey2 << key_end;
+        leveldb::Slice slKey1(ssKey1.data(), ssKey1.size());
+        leveldb::Slice slKey2(ssKey2.data(), ssKey2.size());
+        pdb->CompactRange(&slKey1, &slKey2);
+    }
 };
 
 #endif // BITCOIN_DBWRAPPER_H
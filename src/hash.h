@@ -207,4 +207,10 @@ public:
  */
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 
+/** Optimized SipHash-2-4 implementation for a uint256 followed by a 32-bit
+ *  integer, as used to hash a COutPoint. It is identical to hashing the 36
+ *  bytes of the uint256 and the little-endian uint32_t with SipHasher.
+ */
+uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
+
 #endif // BITCOIN_HASH_H
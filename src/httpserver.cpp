@@ -601,10 +601,47 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
     assert(!replySent && req);
-    // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
     evbuffer_add(evb, strReply.data(), strReply.size());
+    SendReply(nStatus);
+}
+
+template <typename T>
+static void FreeReplyBody(const void* data, size_t datalen, void* extra)
+{
+    delete static_cast<T*>(extra);
+}
+
+template <typename T>
+void HTTPRequest::WriteReplyOwned(int nStatus, T&& reply)
+{
+    assert(!replySent && req);
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    assert(evb);
+    if (!reply.empty()) {
+        T* pbody = new T(std::move(reply));
+        if (evbuffer_add_reference(evb, pbody->data(), pbody->size(), FreeReplyBody<T>, pbody) != 0) {
+            evbuffer_add(evb, pbody->data(), pbody->size());
+            delete pbody;
+        }
+    }
+    SendReply(nStatus);
+}
+
+void HTTPRequest::WriteReply(int nStatus, std::string&& strReply)
+{
+    WriteReplyOwned(nStatus, std::move(strReply));
+}
+
+void HTTPRequest::WriteReply(int nStatus, std::vector<unsigned char>&& vchReply)
+{
+    WriteReplyOwned(nStatus, std::move(vchReply));
+}
+
+void HTTPRequest::SendReply(int nStatus)
+{
+    // Send event to main http thread to send reply message
     HTTPEvent* ev = new HTTPEvent(eventBase, true,
         std::bind(evhttp_send_reply, req, nStatus, (const char*)NULL, (struct evbuffer *)NULL));
     ev->trigger(0);
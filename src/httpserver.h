@@ -6,6 +6,7 @@
 #define BITCOIN_HTTPSERVER_H
 
 #include <string>
+#include <vector>
 #include <stdint.h>
 #include <functional>
 
@@ -110,6 +111,19 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Write HTTP reply like above, but hand the body over to libevent
+     * instead of copying it. libevent sends it out as the connection
+     * drains and frees it afterwards.
+     */
+    void WriteReply(int nStatus, std::string&& strReply);
+    void WriteReply(int nStatus, std::vector<unsigned char>&& vchReply);
+
+private:
+    template <typename T>
+    void WriteReplyOwned(int nStatus, T&& reply);
+    void SendReply(int nStatus);
 };
 
 /** Event handler closure.
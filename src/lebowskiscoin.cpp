@@ -121,7 +121,7 @@ unsigned int CalculateDogecoinNextWorkRequired(bool fNewDifficultyProtocol, cons
     return bnNew.GetCompact();
 }
 
-bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params& params)
+bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params& params, const uint256* pPowHash)
 {
     /* Except for legacy blocks with full version 1, ensure that
        the chain ID is correct.  Legacy blocks are not allowed since
@@ -148,7 +148,7 @@ bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params&
             return true;
         }
 
-        if (!CheckProofOfWork(block.GetPoWHash(), block.nBits, params)) {
+        if (!CheckProofOfWork(pPowHash ? *pPowHash : block.GetPoWHash(), block.nBits, params)) {
             return error("%s : non-AUX proof of work failed", __func__);
         }
 
@@ -162,7 +162,7 @@ bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params&
 
     if (!block.auxpow->check(block.GetHash(), block.GetChainId(), params))
         return error("%s : AUX POW is not valid", __func__);
-    if (!CheckProofOfWork(block.auxpow->getParentBlockPoWHash(), block.nBits, params))
+    if (!CheckProofOfWork(pPowHash ? *pPowHash : block.auxpow->getParentBlockPoWHash(), block.nBits, params))
         return error("%s : AUX proof of work failed", __func__);
 
     return true;
@@ -17,6 +17,8 @@ unsigned int CalculateDogecoinNextWorkRequired(bool fNewDifficultyProtocol, cons
  * Check proof-of-work of a block header, taking auxpow into account.
  * @param block The block header.
  * @param params Consensus parameters.
+ * @param pPowHash Scrypt hash of the header carrying the PoW (the parent
+ *                 block for auxpow), if already computed.
  * @return True iff the PoW is correct.
  */
-bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params& params);
+bool CheckAuxPowProofOfWork(const CBlockHeader& block, const Consensus::Params& params, const uint256* pPowHash = NULL);
@@ -6,6 +6,7 @@
 #define BITCOIN_MEMUSAGE_H
 
 #include "indirectmap.h"
+#include "support/allocators/pool.h"
 
 #include <stdlib.h>
 
@@ -167,6 +168,16 @@ static inline size_t DynamicUsage(const boost::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(boost_unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+template<typename X, typename Y, typename Z, typename E, size_t N>
+static inline size_t DynamicUsage(const boost::unordered_map<X, Y, Z, E, PoolAllocator<std::pair<const X, Y>, N> >& m)
+{
+    // The nodes live in the chunks of the map's pool, which count whether in use or not
+    size_t usage = MallocUsage(sizeof(void*) * m.bucket_count());
+    for (size_t nChunkSize : m.get_allocator().resource->ChunkSizes())
+        usage += MallocUsage(nChunkSize);
+    return usage;
+}
+
 }
 
 #endif // BITCOIN_MEMUSAGE_H
@@ -20,6 +20,7 @@
 #include "policy/policy.h"
 #include "pow.h"
 #include "primitives/transaction.h"
+#include "scheduler.h"
 #include "script/standard.h"
 #include "timedata.h"
 #include "txmempool.h"
@@ -28,6 +29,7 @@
 #include "validationinterface.h"
 
 #include <algorithm>
+#include <boost/bind/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <queue>
@@ -129,16 +131,9 @@ void BlockAssembler::resetBlock()
     blockFinished = false;
 }
 
-std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
+void BlockAssembler::InitBlock(const CBlockIndex* pindexPrev, bool fMineWitnessTx)
 {
-    int64_t nTimeStart = GetTimeMicros();
-
-    resetBlock();
-
     pblocktemplate.reset(new CBlockTemplate());
-
-    if(!pblocktemplate.get())
-        return nullptr;
     pblock = &pblocktemplate->block; // pointer for convenience
 
     // Add dummy coinbase tx as first transaction
@@ -146,8 +141,6 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
 
-    LOCK2(cs_main, mempool.cs);
-    CBlockIndex* pindexPrev = chainActive.Tip();
     nHeight = pindexPrev->nHeight + 1;
 
     const Consensus::Params& consensus = chainparams.GetConsensus(nHeight);
@@ -175,13 +168,11 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // TODO: replace this with a call to main to assess validity of a mempool
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = IsWitnessEnabled(pindexPrev, consensus) && fMineWitnessTx;
+}
 
-    addPriorityTxs();
-    int nPackagesSelected = 0;
-    int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
-
-    int64_t nTime1 = GetTimeMicros();
+void BlockAssembler::FinishBlock(const CScript& scriptPubKeyIn, const CBlockIndex* pindexPrev)
+{
+    const Consensus::Params& consensus = chainparams.GetConsensus(nHeight);
 
     nLastBlockTx = nBlockTx;
     nLastBlockSize = nBlockSize;
@@ -209,6 +200,44 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, consensus);
     pblock->nNonce         = 0;
     pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx, CBlockTemplateSelection* pselection)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    resetBlock();
+
+    LOCK2(cs_main, mempool.cs);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    InitBlock(pindexPrev, fMineWitnessTx);
+
+    addPriorityTxs();
+    int nPackagesSelected = 0;
+    int nDescendantsUpdated = 0;
+    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+
+    int64_t nTime1 = GetTimeMicros();
+
+    if (pselection) {
+        CBlockTemplateSelection& selection = *pselection;
+        selection.pindexPrev = pindexPrev;
+        selection.nHeight = nHeight;
+        selection.nLockTimeCutoff = nLockTimeCutoff;
+        selection.fIncludeWitness = fIncludeWitness;
+        selection.vtx.assign(pblock->vtx.begin() + 1, pblock->vtx.end());
+        selection.vTxFees.assign(pblocktemplate->vTxFees.begin() + 1, pblocktemplate->vTxFees.end());
+        selection.vTxSigOpsCost.assign(pblocktemplate->vTxSigOpsCost.begin() + 1, pblocktemplate->vTxSigOpsCost.end());
+        selection.nBlockWeight = nBlockWeight;
+        // nBlockSize is only kept up to date with size accounting
+        selection.nBlockSize = 1000;
+        for (const CTransactionRef& tx : selection.vtx)
+            selection.nBlockSize += ::GetSerializeSize(*tx, SER_NETWORK, PROTOCOL_VERSION);
+        selection.nBlockSigOpsCost = nBlockSigOpsCost;
+        selection.nFees = nFees;
+    }
+
+    FinishBlock(scriptPubKeyIn, pindexPrev);
 
     CValidationState state;
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
@@ -221,6 +250,75 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     return std::move(pblocktemplate);
 }
 
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, const CBlockTemplateSelection& selection)
+{
+    AssertLockHeld(cs_main);
+    assert(selection.pindexPrev == chainActive.Tip());
+
+    resetBlock();
+    InitBlock(selection.pindexPrev, selection.fIncludeWitness);
+    fIncludeWitness = selection.fIncludeWitness;
+
+    pblock->vtx.insert(pblock->vtx.end(), selection.vtx.begin(), selection.vtx.end());
+    pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), selection.vTxFees.begin(), selection.vTxFees.end());
+    pblocktemplate->vTxSigOpsCost.insert(pblocktemplate->vTxSigOpsCost.end(), selection.vTxSigOpsCost.begin(), selection.vTxSigOpsCost.end());
+    nBlockWeight = selection.nBlockWeight;
+    nBlockSize = selection.nBlockSize;
+    nBlockTx = selection.vtx.size();
+    nBlockSigOpsCost = selection.nBlockSigOpsCost;
+    nFees = selection.nFees;
+
+    // The selection only ever holds transactions accepted to the mempool on
+    // top of its parents, so unlike a fresh selection it is not re-validated
+    FinishBlock(scriptPubKeyIn, selection.pindexPrev);
+
+    return std::move(pblocktemplate);
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateEmptyBlock(const CScript& scriptPubKeyIn)
+{
+    resetBlock();
+
+    LOCK(cs_main);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    InitBlock(pindexPrev, false);
+    FinishBlock(scriptPubKeyIn, pindexPrev);
+
+    CValidationState state;
+    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+        throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
+    }
+
+    return std::move(pblocktemplate);
+}
+
+bool BlockAssembler::AddToSelection(CBlockTemplateSelection& selection, CTxMemPool::txiter iter) const
+{
+    if (iter->GetModifiedFee() < blockMinFeeRate.GetFee(iter->GetTxSize()))
+        return false;
+    // Same vsize-based weight accounting as TestPackage
+    if (selection.nBlockWeight + WITNESS_SCALE_FACTOR * iter->GetTxSize() >= nBlockMaxWeight)
+        return false;
+    if (selection.nBlockSigOpsCost + iter->GetSigOpCost() >= MAX_BLOCK_SIGOPS_COST)
+        return false;
+    uint64_t nTxSize = ::GetSerializeSize(iter->GetTx(), SER_NETWORK, PROTOCOL_VERSION);
+    if (fNeedSizeAccounting && selection.nBlockSize + nTxSize >= nBlockMaxSize)
+        return false;
+    if (!IsFinalTx(iter->GetTx(), selection.nHeight, selection.nLockTimeCutoff))
+        return false;
+    if (!selection.fIncludeWitness && iter->GetTx().HasWitness())
+        return false;
+
+    selection.vtx.push_back(iter->GetSharedTx());
+    selection.vTxFees.push_back(iter->GetFee());
+    selection.vTxSigOpsCost.push_back(iter->GetSigOpCost());
+    selection.nBlockWeight += iter->GetTxWeight();
+    selection.nBlockSize += nTxSize;
+    selection.nBlockSigOpsCost += iter->GetSigOpCost();
+    selection.nFees += iter->GetFee();
+    return true;
+}
+
 bool BlockAssembler::isStillDependent(CTxMemPool::txiter iter)
 {
     BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
@@ -634,6 +732,411 @@ void BlockAssembler::addPriorityTxs()
     fNeedSizeAccounting = fSizeAccounting;
 }
 
+std::unique_ptr<CBlockTemplateManager> g_blockTemplateManager;
+
+CBlockTemplateManager::CBlockTemplateManager(const CChainParams& chainparams, int64_t nRebuildIntervalIn)
+    : assembler(chainparams), nRemovedSelected(0), fValid(false), fComplete(false), fMineWitnessTx(false), nStaleSince(0), nRebuildInterval(nRebuildIntervalIn)
+{
+    mempool.NotifyEntryAdded.connect(boost::bind(&CBlockTemplateManager::TransactionAddedToMempool,
+                                                 this, boost::placeholders::_1));
+    mempool.NotifyEntryRemoved.connect(boost::bind(&CBlockTemplateManager::TransactionRemovedFromMempool,
+                                                   this, boost::placeholders::_1,
+                                                   boost::placeholders::_2));
+}
+
+CBlockTemplateManager::~CBlockTemplateManager()
+{
+    mempool.NotifyEntryAdded.disconnect(boost::bind(&CBlockTemplateManager::TransactionAddedToMempool,
+                                                    this, boost::placeholders::_1));
+    mempool.NotifyEntryRemoved.disconnect(boost::bind(&CBlockTemplateManager::TransactionRemovedFromMempool,
+                                                      this, boost::placeholders::_1,
+                                                      boost::placeholders::_2));
+}
+
+void CBlockTemplateManager::Invalidate()
+{
+    fValid = false;
+    selection = CBlockTemplateSelection();
+    setSelected.clear();
+    vAdded.clear();
+    nRemovedSelected = 0;
+}
+
+void CBlockTemplateManager::MarkStale()
+{
+    fComplete = false;
+    if (nStaleSince == 0)
+        nStaleSince = GetTime();
+}
+
+void CBlockTemplateManager::TransactionAddedToMempool(CTransactionRef tx)
+{
+    // Called before the entry is in mapTx, so it is only looked at by Update
+    LOCK(cs);
+    if (!fValid)
+        return;
+    vAdded.push_back(tx->GetHash());
+    if (vAdded.size() > MAX_TEMPLATE_QUEUED_TXS)
+        Invalidate();
+}
+
+void CBlockTemplateManager::TransactionRemovedFromMempool(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    LOCK(cs);
+    if (!fValid)
+        return;
+    // Descendants are removed along with a transaction (other than one that
+    // was mined), so the rest of the selection keeps its parents
+    if (setSelected.erase(tx->GetHash()))
+        nRemovedSelected++;
+}
+
+void CBlockTemplateManager::SyncTransaction(const CTransaction &tx, const CBlockIndex *pindex, int posInBlock)
+{
+    // A transaction of a disconnected block
+    if (pindex && posInBlock == CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK) {
+        LOCK(cs);
+        Invalidate();
+    }
+}
+
+void CBlockTemplateManager::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    if (fInitialDownload)
+        return;
+    // Have the selection ready on the new tip before it is asked for
+    LOCK2(cs_main, mempool.cs);
+    LOCK(cs);
+    Update();
+}
+
+void CBlockTemplateManager::Update()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+    AssertLockHeld(cs);
+    if (!fValid)
+        return;
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (selection.pindexPrev != pindexTip) {
+        if (pindexTip->GetAncestor(selection.pindexPrev->nHeight) != selection.pindexPrev) {
+            Invalidate();
+            return;
+        }
+        // Lock times and maturity only loosen as the chain grows
+        const Consensus::Params& consensus = Params().GetConsensus(pindexTip->nHeight + 1);
+        if ((IsWitnessEnabled(pindexTip, consensus) && fMineWitnessTx) != selection.fIncludeWitness) {
+            Invalidate();
+            return;
+        }
+        selection.pindexPrev = pindexTip;
+        selection.nHeight = pindexTip->nHeight + 1;
+        selection.nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                                     ? pindexTip->GetMedianTimePast()
+                                     : GetAdjustedTime();
+        // Transactions left out before may be final now
+        if (!fComplete)
+            MarkStale();
+    }
+
+    unsigned int nRemoved = nRemovedSelected;
+    if (nRemovedSelected > 0) {
+        size_t j = 0;
+        for (size_t i = 0; i < selection.vtx.size(); i++) {
+            const CTransactionRef& tx = selection.vtx[i];
+            if (!setSelected.count(tx->GetHash())) {
+                selection.nBlockWeight -= GetTransactionWeight(*tx);
+                selection.nBlockSize -= ::GetSerializeSize(*tx, SER_NETWORK, PROTOCOL_VERSION);
+                selection.nBlockSigOpsCost -= selection.vTxSigOpsCost[i];
+                selection.nFees -= selection.vTxFees[i];
+                continue;
+            }
+            if (i != j) {
+                selection.vtx[j] = selection.vtx[i];
+                selection.vTxFees[j] = selection.vTxFees[i];
+                selection.vTxSigOpsCost[j] = selection.vTxSigOpsCost[i];
+            }
+            j++;
+        }
+        selection.vtx.resize(j);
+        selection.vTxFees.resize(j);
+        selection.vTxSigOpsCost.resize(j);
+        nRemovedSelected = 0;
+        // Transactions left out before may fit now
+        if (!fComplete)
+            MarkStale();
+    }
+
+    size_t nAdded = 0;
+    for (const uint256& hash : vAdded) {
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end() || setSelected.count(hash))
+            continue;
+        bool fParentsSelected = true;
+        BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(it)) {
+            if (!setSelected.count(parent->GetTx().GetHash())) {
+                fParentsSelected = false;
+                break;
+            }
+        }
+        if (!fParentsSelected || !assembler.AddToSelection(selection, it)) {
+            MarkStale();
+            continue;
+        }
+        setSelected.insert(hash);
+        nAdded++;
+    }
+    vAdded.clear();
+
+    LogPrint("bench", "CBlockTemplateManager: %u txs removed, %u added, %u selected\n", nRemoved, nAdded, selection.vtx.size());
+}
+
+void CBlockTemplateManager::Rebuild(const CScript& scriptPubKeyIn, bool fMineWitnessTxIn, std::unique_ptr<CBlockTemplate>& pblocktemplate)
+{
+    Invalidate();
+    CBlockTemplateSelection selectionNew;
+    pblocktemplate = assembler.CreateNewBlock(scriptPubKeyIn, fMineWitnessTxIn, &selectionNew);
+    selection = selectionNew;
+    for (const CTransactionRef& tx : selection.vtx)
+        setSelected.insert(tx->GetHash());
+    fMineWitnessTx = fMineWitnessTxIn;
+    fComplete = selection.vtx.size() == mempool.size();
+    nStaleSince = 0;
+    fValid = true;
+}
+
+std::unique_ptr<CBlockTemplate> CBlockTemplateManager::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTxIn)
+{
+    int64_t nTimeStart = GetTimeMicros();
+    LOCK2(cs_main, mempool.cs);
+    LOCK(cs);
+
+    Update();
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    if (!fValid || fMineWitnessTx != fMineWitnessTxIn || (nStaleSince != 0 && GetTime() - nStaleSince >= nRebuildInterval)) {
+        Rebuild(scriptPubKeyIn, fMineWitnessTxIn, pblocktemplate);
+    } else {
+        pblocktemplate = assembler.CreateNewBlock(scriptPubKeyIn, selection);
+        LogPrint("bench", "CreateNewBlock() from maintained selection: %.2fms\n", 0.001 * (GetTimeMicros() - nTimeStart));
+    }
+    return pblocktemplate;
+}
+
+std::unique_ptr<CBlockTemplate> CreateBlockTemplate(const CChainParams& chainparams, const CScript& scriptPubKeyIn, bool fMineWitnessTx)
+{
+    if (g_blockTemplateManager)
+        return g_blockTemplateManager->CreateNewBlock(scriptPubKeyIn, fMineWitnessTx);
+    return BlockAssembler(chainparams).CreateNewBlock(scriptPubKeyIn, fMineWitnessTx);
+}
+
+std::unique_ptr<CAuxBlockCache> g_auxBlockCache;
+
+CAuxBlockCache::CAuxBlockCache(const CChainParams& chainparamsIn, CScheduler& schedulerIn)
+    : chainparams(chainparamsIn), scheduler(schedulerIn), pindexPrev(NULL), nUseCounter(0), nExtraNonce(0), nNotifySequence(0), fInterrupted(false)
+{
+}
+
+void CAuxBlockCache::EraseTemplates(CScriptTemplates& entry)
+{
+    for (const std::shared_ptr<CBlockTemplate>& pblocktemplate : entry.templates)
+        mapBlocks.erase(pblocktemplate->block.GetHash());
+    entry.templates.clear();
+    entry.fEmpty = false;
+}
+
+void CAuxBlockCache::SyncTip()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs);
+    if (pindexPrev == chainActive.Tip())
+        return;
+    for (std::map<CScriptID, CScriptTemplates>::iterator it = mapScripts.begin(); it != mapScripts.end(); ++it) {
+        it->second.templates.clear();
+        it->second.fEmpty = false;
+    }
+    mapBlocks.clear();
+    pindexPrev = chainActive.Tip();
+}
+
+void CAuxBlockCache::AddTemplate(CScriptTemplates& entry, std::unique_ptr<CBlockTemplate> pblocktemplate, bool fEmpty)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs);
+    // Finalise it by setting the version and building the merkle root
+    IncrementExtraNonce(&pblocktemplate->block, pindexPrev, nExtraNonce);
+    pblocktemplate->block.SetAuxpowFlag(true);
+
+    std::shared_ptr<CBlockTemplate> shared_template(std::move(pblocktemplate));
+    mapBlocks[shared_template->block.GetHash()] = shared_template;
+    entry.templates.push_front(shared_template);
+    while (entry.templates.size() > MAX_AUX_BLOCK_TEMPLATES) {
+        mapBlocks.erase(entry.templates.back()->block.GetHash());
+        entry.templates.pop_back();
+    }
+    entry.fEmpty = fEmpty;
+    entry.fServed = false;
+    entry.nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    entry.nCreated = GetTime();
+
+    GetMainSignals().NewAuxBlock(shared_template->block);
+    {
+        boost::unique_lock<boost::mutex> lock(csNotify);
+        nNotifySequence++;
+    }
+    cvNotify.notify_all();
+}
+
+bool CAuxBlockCache::IsOutdated(const CScriptTemplates& entry) const
+{
+    if (entry.templates.empty())
+        return true;
+    if (mempool.GetTransactionsUpdated() == entry.nTransactionsUpdated)
+        return false;
+    // A coinbase-only template is served until its full one is built
+    return (!entry.fServed && !entry.fEmpty) || GetTime() - entry.nCreated > AUX_BLOCK_REFRESH_INTERVAL;
+}
+
+std::shared_ptr<const CBlockTemplate> CAuxBlockCache::Get(const CScript& scriptPubKey)
+{
+    LOCK2(cs_main, cs);
+    SyncTip();
+
+    const CScriptID scriptID(scriptPubKey);
+    std::map<CScriptID, CScriptTemplates>::iterator it = mapScripts.find(scriptID);
+    if (it == mapScripts.end()) {
+        if (mapScripts.size() >= MAX_AUX_BLOCK_SCRIPTS) {
+            std::map<CScriptID, CScriptTemplates>::iterator itOldest = mapScripts.begin();
+            for (std::map<CScriptID, CScriptTemplates>::iterator itEvict = mapScripts.begin(); itEvict != mapScripts.end(); ++itEvict) {
+                if (itEvict->second.nLastUsed < itOldest->second.nLastUsed)
+                    itOldest = itEvict;
+            }
+            EraseTemplates(itOldest->second);
+            mapScripts.erase(itOldest);
+        }
+        it = mapScripts.insert(std::make_pair(scriptID, CScriptTemplates())).first;
+        it->second.scriptPubKey = scriptPubKey;
+    }
+    CScriptTemplates& entry = it->second;
+    entry.nLastUsed = ++nUseCounter;
+
+    if (IsOutdated(entry))
+    {
+        // lebowskiscoin: Never mine witness tx
+        std::unique_ptr<CBlockTemplate> pblocktemplate = CreateBlockTemplate(chainparams, scriptPubKey, false);
+        if (!pblocktemplate)
+            return NULL;
+        AddTemplate(entry, std::move(pblocktemplate), false);
+    }
+    entry.fServed = true;
+    return entry.templates.front();
+}
+
+std::shared_ptr<const CBlockTemplate> CAuxBlockCache::Find(const uint256& hash) const
+{
+    LOCK(cs);
+    std::map<uint256, std::shared_ptr<CBlockTemplate> >::const_iterator it = mapBlocks.find(hash);
+    if (it == mapBlocks.end())
+        return NULL;
+    return it->second;
+}
+
+uint256 CAuxBlockCache::GetCurrentHash(const CScript& scriptPubKey) const
+{
+    LOCK2(cs_main, cs);
+    if (pindexPrev != chainActive.Tip())
+        return uint256();
+    std::map<CScriptID, CScriptTemplates>::const_iterator it = mapScripts.find(CScriptID(scriptPubKey));
+    if (it == mapScripts.end() || IsOutdated(it->second))
+        return uint256();
+    return it->second.templates.front()->block.GetHash();
+}
+
+bool CAuxBlockCache::WaitForNewBlock(const CScript& scriptPubKey, const uint256& hashWatched, const boost::system_time& deadline)
+{
+    while (true) {
+        uint64_t nSequence;
+        {
+            boost::unique_lock<boost::mutex> lock(csNotify);
+            if (fInterrupted)
+                return false;
+            nSequence = nNotifySequence;
+        }
+        // Not under csNotify, which is taken with cs held
+        if (GetCurrentHash(scriptPubKey) != hashWatched)
+            return true;
+        boost::unique_lock<boost::mutex> lock(csNotify);
+        while (nNotifySequence == nSequence && !fInterrupted) {
+            if (!cvNotify.timed_wait(lock, deadline))
+                return false;
+        }
+    }
+}
+
+void CAuxBlockCache::Interrupt()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csNotify);
+        fInterrupted = true;
+    }
+    cvNotify.notify_all();
+}
+
+void CAuxBlockCache::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    if (fInitialDownload)
+        return;
+    {
+        LOCK2(cs_main, cs);
+        SyncTip();
+        if (mapScripts.empty())
+            return;
+        int64_t nTimeStart = GetTimeMicros();
+        for (std::map<CScriptID, CScriptTemplates>::iterator it = mapScripts.begin(); it != mapScripts.end(); ++it) {
+            if (!it->second.templates.empty())
+                continue;
+            try {
+                AddTemplate(it->second, BlockAssembler(chainparams).CreateEmptyBlock(it->second.scriptPubKey), true);
+            } catch (const std::exception& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+            }
+        }
+        LogPrint("bench", "CAuxBlockCache: %u empty templates on %s: %.2fms\n", mapScripts.size(), pindexPrev->GetBlockHash().ToString(), 0.001 * (GetTimeMicros() - nTimeStart));
+    }
+    scheduler.scheduleFromNow(boost::bind(&CAuxBlockCache::BuildFullTemplates, this), 0);
+}
+
+void CAuxBlockCache::BuildFullTemplates()
+{
+    LOCK2(cs_main, cs);
+    // Templates of a tip that has since been replaced are gone; the
+    // notification for the new tip schedules another run
+    SyncTip();
+    for (std::map<CScriptID, CScriptTemplates>::iterator it = mapScripts.begin(); it != mapScripts.end(); ++it) {
+        if (!it->second.fEmpty)
+            continue;
+        try {
+            std::unique_ptr<CBlockTemplate> pblocktemplate = CreateBlockTemplate(chainparams, it->second.scriptPubKey, false);
+            if (pblocktemplate)
+                AddTemplate(it->second, std::move(pblocktemplate), false);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+    }
+}
+
+size_t CAuxBlockCache::GetScriptCount() const
+{
+    LOCK(cs);
+    return mapScripts.size();
+}
+
+size_t CAuxBlockCache::GetTemplateCount() const
+{
+    LOCK(cs);
+    return mapBlocks.size();
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -8,22 +8,39 @@
 #define BITCOIN_MINER_H
 
 #include "primitives/block.h"
+#include "script/standard.h"
+#include "sync.h"
 #include "txmempool.h"
+#include "validationinterface.h"
 
 #include <stdint.h>
+#include <deque>
+#include <map>
 #include <memory>
+#include <set>
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
 
 class CBlockIndex;
 class CChainParams;
 class CReserveKey;
+class CScheduler;
 class CScript;
 class CWallet;
 
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+//! -blocktemplaterebuild default: seconds a template may lag the best selection before it is rebuilt
+static const int64_t DEFAULT_BLOCK_TEMPLATE_REBUILD = 5;
+//! Mempool additions queued for the template before it is rebuilt instead
+static const size_t MAX_TEMPLATE_QUEUED_TXS = 100000;
+//! Payout scripts the AuxPoW block cache keeps templates for
+static const size_t MAX_AUX_BLOCK_SCRIPTS = 16;
+//! Templates on the current tip kept per payout script, so that work on older ones can still be submitted
+static const size_t MAX_AUX_BLOCK_TEMPLATES = 4;
+//! Seconds before an AuxPoW template is rebuilt to pick up mempool changes
+static const int64_t AUX_BLOCK_REFRESH_INTERVAL = 60;
 
 struct CBlockTemplate
 {
@@ -33,6 +50,27 @@ struct CBlockTemplate
     std::vector<unsigned char> vchCoinbaseCommitment;
 };
 
+/** The transactions of a block template without its coinbase, and the chain
+ *  context they were selected for. Totals include the coinbase reservation. */
+struct CBlockTemplateSelection
+{
+    const CBlockIndex* pindexPrev;
+    int nHeight;
+    int64_t nLockTimeCutoff;
+    bool fIncludeWitness;
+
+    std::vector<CTransactionRef> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOpsCost;
+
+    uint64_t nBlockWeight;
+    uint64_t nBlockSize;
+    uint64_t nBlockSigOpsCost;
+    CAmount nFees;
+
+    CBlockTemplateSelection() : pindexPrev(NULL), nHeight(0), nLockTimeCutoff(0), fIncludeWitness(false), nBlockWeight(0), nBlockSize(0), nBlockSigOpsCost(0), nFees(0) {}
+};
+
 // Container for tracking updates to ancestor feerate as we include (parent)
 // transactions in a block
 struct CTxMemPoolModifiedEntry {
@@ -165,13 +203,27 @@ private:
 
 public:
     BlockAssembler(const CChainParams& chainparams);
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
-    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx);
+    /** Construct a new block template with coinbase to scriptPubKeyIn,
+     *  storing the transactions it selected in pselection if given */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx, CBlockTemplateSelection* pselection = NULL);
+    /** Construct a block template with coinbase to scriptPubKeyIn from the
+     *  transactions of a selection built on the current tip */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, const CBlockTemplateSelection& selection);
+    /** Construct a block template with coinbase to scriptPubKeyIn and no
+     *  other transactions on the current tip */
+    std::unique_ptr<CBlockTemplate> CreateEmptyBlock(const CScript& scriptPubKeyIn);
+    /** Append a mempool transaction whose in-mempool parents are already
+     *  selected to selection, if it fits and may be mined in that block */
+    bool AddToSelection(CBlockTemplateSelection& selection, CTxMemPool::txiter iter) const;
 
 private:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
+    /** Start a block on pindexPrev: header version and time, lock time cutoff and witness inclusion */
+    void InitBlock(const CBlockIndex* pindexPrev, bool fMineWitnessTx);
+    /** Add the coinbase paying scriptPubKeyIn and fill in the rest of the header */
+    void FinishBlock(const CScript& scriptPubKeyIn, const CBlockIndex* pindexPrev);
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
 
@@ -210,6 +262,154 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/**
+ * Keeps the transaction selection of the best block template up to date as
+ * transactions enter and leave the mempool and blocks are connected, so that
+ * a template costs a walk over the changes since the last one rather than a
+ * package selection over the whole mempool under cs_main.
+ *
+ * Transactions that arrive after the selection was built are appended when
+ * their parents are selected and they fit. A selection that missed a
+ * transaction (or left some out when it was built and has since lost
+ * transactions to a block) is stale, and is rebuilt from scratch by the
+ * first request at least -blocktemplaterebuild seconds after it became so.
+ * Disconnected blocks, which put transactions back in front of ones already
+ * selected, force a rebuild.
+ *
+ * Lock order: cs_main, mempool.cs, cs.
+ */
+class CBlockTemplateManager : public CValidationInterface
+{
+private:
+    mutable CCriticalSection cs;
+    BlockAssembler assembler;
+    CBlockTemplateSelection selection;
+    //! Txids in selection
+    std::set<uint256> setSelected;
+    //! Txids added to the mempool since the last update, oldest first
+    std::vector<uint256> vAdded;
+    //! Selected transactions removed from the mempool since the last update
+    unsigned int nRemovedSelected;
+    //! Whether selection is consistent with the mempool and the chain
+    bool fValid;
+    //! Whether selection holds every mempool transaction it was offered
+    bool fComplete;
+    bool fMineWitnessTx;
+    //! Time selection was first found to miss a better transaction, or 0
+    int64_t nStaleSince;
+    int64_t nRebuildInterval;
+
+    void TransactionAddedToMempool(CTransactionRef tx);
+    void TransactionRemovedFromMempool(CTransactionRef tx, MemPoolRemovalReason reason);
+    void Invalidate();
+    void MarkStale();
+    /** Bring selection up to date with the tip and the mempool */
+    void Update();
+    void Rebuild(const CScript& scriptPubKeyIn, bool fMineWitnessTxIn, std::unique_ptr<CBlockTemplate>& pblocktemplate);
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload);
+    void SyncTransaction(const CTransaction &tx, const CBlockIndex *pindex, int posInBlock);
+
+public:
+    CBlockTemplateManager(const CChainParams& chainparams, int64_t nRebuildIntervalIn);
+    ~CBlockTemplateManager();
+
+    /** Block template with coinbase to scriptPubKeyIn on the current tip */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx);
+};
+
+/** Template manager used for RPC mining, if any */
+extern std::unique_ptr<CBlockTemplateManager> g_blockTemplateManager;
+
+/** Block template with coinbase to scriptPubKeyIn, from the template manager if there is one */
+std::unique_ptr<CBlockTemplate> CreateBlockTemplate(const CChainParams& chainparams, const CScript& scriptPubKeyIn, bool fMineWitnessTx);
+
+/**
+ * Blocks handed out for merged mining, per payout script, on the current tip.
+ *
+ * A script keeps its newest MAX_AUX_BLOCK_TEMPLATES templates, and the
+ * least recently used of more than MAX_AUX_BLOCK_SCRIPTS scripts is evicted
+ * with its templates. When the tip changes, every cached script gets a
+ * coinbase-only template straight away, so merged-mining parents can move
+ * to the new tip without waiting for transaction selection. Full templates
+ * replace those on the scheduler thread. A template is refreshed for
+ * mempool changes once it is AUX_BLOCK_REFRESH_INTERVAL seconds old, or
+ * right away if no one has been given it yet. Every template added is
+ * announced through the NewAuxBlock signal.
+ *
+ * Lock order: cs_main, cs, csNotify.
+ */
+class CAuxBlockCache : public CValidationInterface
+{
+private:
+    struct CScriptTemplates
+    {
+        CScript scriptPubKey;
+        //! Newest first, all on pindexPrev
+        std::deque<std::shared_ptr<CBlockTemplate> > templates;
+        //! Whether the newest template is a coinbase-only one awaiting a full one
+        bool fEmpty;
+        //! Whether the newest template has been handed out
+        bool fServed;
+        unsigned int nTransactionsUpdated;
+        int64_t nCreated;
+        uint64_t nLastUsed;
+
+        CScriptTemplates() : fEmpty(false), fServed(false), nTransactionsUpdated(0), nCreated(0), nLastUsed(0) {}
+    };
+
+    mutable CCriticalSection cs;
+    const CChainParams& chainparams;
+    CScheduler& scheduler;
+    const CBlockIndex* pindexPrev;
+    std::map<CScriptID, CScriptTemplates> mapScripts;
+    std::map<uint256, std::shared_ptr<CBlockTemplate> > mapBlocks;
+    uint64_t nUseCounter;
+    unsigned int nExtraNonce;
+
+    //! Bumped, waking long-polling callers, whenever a template is added
+    CWaitableCriticalSection csNotify;
+    CConditionVariable cvNotify;
+    uint64_t nNotifySequence;
+    bool fInterrupted;
+
+    /** Drop templates that are not on the current tip */
+    void SyncTip();
+    void AddTemplate(CScriptTemplates& entry, std::unique_ptr<CBlockTemplate> pblocktemplate, bool fEmpty);
+    void EraseTemplates(CScriptTemplates& entry);
+    /** Whether Get should build a new template for entry */
+    bool IsOutdated(const CScriptTemplates& entry) const;
+    /** Replace the coinbase-only templates with full ones */
+    void BuildFullTemplates();
+    /** Hash of the block Get would return for scriptPubKey, or null if it would build a new one */
+    uint256 GetCurrentHash(const CScript& scriptPubKey) const;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload);
+
+public:
+    CAuxBlockCache(const CChainParams& chainparamsIn, CScheduler& schedulerIn);
+
+    /** Newest template paying to scriptPubKey on the current tip, built if
+     *  there is none or it is due for a refresh */
+    std::shared_ptr<const CBlockTemplate> Get(const CScript& scriptPubKey);
+    /** Template handed out with block hash, or NULL if it is unknown or obsolete */
+    std::shared_ptr<const CBlockTemplate> Find(const uint256& hash) const;
+    /** Wait until the block for scriptPubKey is no longer hashWatched (there
+     *  is a new tip, a full template, or it is due for a refresh); false if
+     *  deadline passes or waiting is interrupted first */
+    bool WaitForNewBlock(const CScript& scriptPubKey, const uint256& hashWatched, const boost::system_time& deadline);
+    /** Wake up and stop all waiting callers */
+    void Interrupt();
+
+    size_t GetScriptCount() const;
+    size_t GetTemplateCount() const;
+};
+
+/** AuxPoW block cache used by createauxblock and getauxblock */
+extern std::unique_ptr<CAuxBlockCache> g_auxBlockCache;
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
@@ -29,6 +29,14 @@
 #include <fcntl.h>
 #endif
 
+#ifdef USE_POLL
+#include <poll.h>
+#endif
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -45,6 +53,15 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+// Frequency to poll pnode->vSend when no socket becomes ready (milliseconds)
+static const int SOCKET_EVENTS_TIMEOUT_MS = 50;
+
+#ifdef USE_EPOLL
+// Ready sockets returned per epoll_wait(); any further ones are level-triggered
+// and get picked up by the next call.
+static const int MAX_EPOLL_EVENTS = 1024;
+#endif
+
 #if !defined(HAVE_MSG_NOSIGNAL) && !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -90,6 +107,49 @@ unsigned short GetListenPort()
     return (unsigned short)(GetArg("-port", Params().GetDefaultPort()));
 }
 
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& mode)
+{
+    if (strMode == "select") {
+        mode = SOCKETEVENTS_SELECT;
+        return true;
+    }
+#ifdef USE_POLL
+    if (strMode == "poll") {
+        mode = SOCKETEVENTS_POLL;
+        return true;
+    }
+#endif
+#ifdef USE_EPOLL
+    if (strMode == "epoll") {
+        mode = SOCKETEVENTS_EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string GetSocketEventsModeName(SocketEventsMode mode)
+{
+    switch (mode) {
+    case SOCKETEVENTS_SELECT: return "select";
+    case SOCKETEVENTS_POLL: return "poll";
+    case SOCKETEVENTS_EPOLL: return "epoll";
+    }
+    return "unknown";
+}
+
+std::string GetSupportedSocketEventsModes()
+{
+    std::string strModes = "select";
+#ifdef USE_POLL
+    strModes += ", poll";
+#endif
+#ifdef USE_EPOLL
+    strModes += ", epoll";
+#endif
+    return strModes;
+}
+
 // find 'best' local address for a particular peer
 bool GetLocal(CService& addr, const CNetAddr *paddrPeer)
 {
@@ -654,6 +714,7 @@ void CNode::copyStats(CNodeStats &stats)
     {
         LOCK(cs_vRecv);
         X(mapRecvBytesPerMsgCmd);
+        X(mapRecvQueueTimePerMsgCmd);
         X(nRecvBytes);
     }
     X(fWhitelisted);
@@ -735,6 +796,19 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     return true;
 }
 
+void CNode::RecordRecvQueueTime(const std::string& strCommand, int64_t nQueueMicros)
+{
+    LOCK(cs_vRecv);
+    // to prevent a memory DOS, only allow valid commands
+    mapMsgCmdQueueTime::iterator i = mapRecvQueueTimePerMsgCmd.find(strCommand);
+    if (i == mapRecvQueueTimePerMsgCmd.end())
+        i = mapRecvQueueTimePerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(i != mapRecvQueueTimePerMsgCmd.end());
+    i->second.nCount++;
+    i->second.nTotalMicros += nQueueMicros;
+    i->second.nMaxMicros = std::max(i->second.nMaxMicros, nQueueMicros);
+}
+
 void CNode::SetSendVersion(int nVersionIn)
 {
     // Send version may only be changed in the version message, and
@@ -1059,7 +1133,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (socketEventsMode == SOCKETEVENTS_SELECT && !IsSelectableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1158,6 +1232,250 @@ void CConnman::DeleteDisconnectedNodes()
     }
 }
 
+void CConnman::GenerateSocketInterest(socket_interest_map_t& mapInterest)
+{
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        if (hListenSocket.socket != INVALID_SOCKET)
+            mapInterest.insert(std::make_pair(hListenSocket.socket, SocketInterest(-1, SOCKET_EVENT_RECV)));
+    }
+
+    LOCK(cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, vNodes)
+    {
+        // Implement the following logic:
+        // * If there is data to send, wait for sending data. As this only
+        //   happens when optimistic write failed, we choose to first drain the
+        //   write buffer in this case before receiving more. This avoids
+        //   needlessly queueing received data, if the remote peer is not themselves
+        //   receiving data. This means properly utilizing TCP flow control signalling.
+        // * Otherwise, if there is space left in the receive buffer, wait for
+        //   receiving data.
+        // * Hand off all complete messages to the processor, to be handled without
+        //   blocking here.
+
+        bool select_recv = !pnode->fPauseRecv;
+        bool select_send;
+        {
+            LOCK(pnode->cs_vSend);
+            select_send = !pnode->vSendMsg.empty();
+        }
+
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+
+        unsigned int nEvents = SOCKET_EVENT_ERROR;
+        if (select_send)
+            nEvents |= SOCKET_EVENT_SEND;
+        else if (select_recv)
+            nEvents |= SOCKET_EVENT_RECV;
+        mapInterest.insert(std::make_pair(pnode->hSocket, SocketInterest(pnode->GetId(), nEvents)));
+    }
+}
+
+bool CConnman::SocketEvents(const socket_interest_map_t& mapInterest, socket_events_map_t& mapReady)
+{
+    bool fContinue;
+    switch (socketEventsMode) {
+#ifdef USE_EPOLL
+    case SOCKETEVENTS_EPOLL:
+        fContinue = SocketEventsEpoll(mapInterest, mapReady);
+        break;
+#endif
+#ifdef USE_POLL
+    case SOCKETEVENTS_POLL:
+        fContinue = SocketEventsPoll(mapInterest, mapReady);
+        break;
+#endif
+    default:
+        fContinue = SocketEventsSelect(mapInterest, mapReady);
+        break;
+    }
+    nSocketWakeups++;
+    return fContinue;
+}
+
+bool CConnman::SocketEventsSelect(const socket_interest_map_t& mapInterest, socket_events_map_t& mapReady)
+{
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = SOCKET_EVENTS_TIMEOUT_MS * 1000;
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    for (const auto& entry : mapInterest) {
+        if (entry.second.nEvents & SOCKET_EVENT_RECV)
+            FD_SET(entry.first, &fdsetRecv);
+        if (entry.second.nEvents & SOCKET_EVENT_SEND)
+            FD_SET(entry.first, &fdsetSend);
+        if (entry.second.nEvents & SOCKET_EVENT_ERROR)
+            FD_SET(entry.first, &fdsetError);
+        hSocketMax = std::max(hSocketMax, entry.first);
+        have_fds = true;
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return false;
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (const auto& entry : mapInterest)
+                mapReady[entry.first] = SOCKET_EVENT_RECV;
+        }
+        return interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT_MS));
+    }
+
+    for (const auto& entry : mapInterest) {
+        unsigned int nEvents = 0;
+        if (FD_ISSET(entry.first, &fdsetRecv))
+            nEvents |= SOCKET_EVENT_RECV;
+        if (FD_ISSET(entry.first, &fdsetSend))
+            nEvents |= SOCKET_EVENT_SEND;
+        if (FD_ISSET(entry.first, &fdsetError))
+            nEvents |= SOCKET_EVENT_ERROR;
+        if (nEvents)
+            mapReady[entry.first] = nEvents;
+    }
+    return true;
+}
+
+#ifdef USE_POLL
+bool CConnman::SocketEventsPoll(const socket_interest_map_t& mapInterest, socket_events_map_t& mapReady)
+{
+    std::vector<struct pollfd> vPollFds;
+    vPollFds.reserve(mapInterest.size());
+    for (const auto& entry : mapInterest) {
+        struct pollfd pollfd;
+        pollfd.fd = entry.first;
+        pollfd.events = 0;
+        pollfd.revents = 0;
+        if (entry.second.nEvents & SOCKET_EVENT_RECV)
+            pollfd.events |= POLLIN;
+        if (entry.second.nEvents & SOCKET_EVENT_SEND)
+            pollfd.events |= POLLOUT;
+        // POLLERR and POLLHUP are always reported
+        vPollFds.push_back(pollfd);
+    }
+
+    int nPoll = poll(vPollFds.data(), vPollFds.size(), SOCKET_EVENTS_TIMEOUT_MS);
+    if (interruptNet)
+        return false;
+
+    if (nPoll == SOCKET_ERROR)
+    {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR)
+            LogPrintf("socket poll error %s\n", NetworkErrorString(nErr));
+        return interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT_MS));
+    }
+
+    for (const struct pollfd& pollfd : vPollFds) {
+        unsigned int nEvents = 0;
+        if (pollfd.revents & POLLIN)
+            nEvents |= SOCKET_EVENT_RECV;
+        if (pollfd.revents & POLLOUT)
+            nEvents |= SOCKET_EVENT_SEND;
+        if (pollfd.revents & (POLLERR | POLLHUP | POLLNVAL))
+            nEvents |= SOCKET_EVENT_ERROR;
+        if (nEvents)
+            mapReady[pollfd.fd] = nEvents;
+    }
+    return true;
+}
+#endif
+
+#ifdef USE_EPOLL
+void CConnman::UpdateEpollInterest(const socket_interest_map_t& mapInterest)
+{
+    // Forget sockets that are gone or now belong to another node. The kernel
+    // drops closed sockets from the epoll set by itself, so DEL may fail.
+    for (socket_interest_map_t::iterator it = mapEpollInterest.begin(); it != mapEpollInterest.end(); ) {
+        socket_interest_map_t::const_iterator itNew = mapInterest.find(it->first);
+        if (itNew == mapInterest.end() || itNew->second.id != it->second.id) {
+            epoll_ctl(epollfd, EPOLL_CTL_DEL, it->first, NULL);
+            it = mapEpollInterest.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Only re-arm sockets whose interest changed, i.e. when fPauseRecv flips
+    // or an optimistic send left data behind (or got drained).
+    for (const auto& entry : mapInterest) {
+        socket_interest_map_t::iterator it = mapEpollInterest.find(entry.first);
+        if (it != mapEpollInterest.end() && it->second == entry.second)
+            continue;
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        if (entry.second.nEvents & SOCKET_EVENT_RECV)
+            event.events |= EPOLLIN;
+        if (entry.second.nEvents & SOCKET_EVENT_SEND)
+            event.events |= EPOLLOUT;
+        // EPOLLERR and EPOLLHUP are always reported
+        event.data.fd = entry.first;
+
+        const bool fRegistered = it != mapEpollInterest.end();
+        if (epoll_ctl(epollfd, fRegistered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, entry.first, &event) != 0) {
+            LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(WSAGetLastError()));
+            // Start from scratch for this socket on the next iteration
+            if (fRegistered) {
+                epoll_ctl(epollfd, EPOLL_CTL_DEL, entry.first, NULL);
+                mapEpollInterest.erase(it);
+            }
+            continue;
+        }
+        if (fRegistered)
+            it->second = entry.second;
+        else
+            mapEpollInterest.insert(entry);
+    }
+}
+
+bool CConnman::SocketEventsEpoll(const socket_interest_map_t& mapInterest, socket_events_map_t& mapReady)
+{
+    UpdateEpollInterest(mapInterest);
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(epollfd, events, MAX_EPOLL_EVENTS, SOCKET_EVENTS_TIMEOUT_MS);
+    if (interruptNet)
+        return false;
+
+    if (nEvents == SOCKET_ERROR)
+    {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR)
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+        return interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT_MS));
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        unsigned int nReady = 0;
+        if (events[i].events & EPOLLIN)
+            nReady |= SOCKET_EVENT_RECV;
+        if (events[i].events & EPOLLOUT)
+            nReady |= SOCKET_EVENT_SEND;
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+            nReady |= SOCKET_EVENT_ERROR;
+        mapReady[events[i].data.fd] |= nReady;
+    }
+    return true;
+}
+#endif
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
@@ -1186,91 +1504,19 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        if (interruptNet)
+        socket_interest_map_t mapInterest;
+        socket_events_map_t mapReady;
+        GenerateSocketInterest(mapInterest);
+        if (!SocketEvents(mapInterest, mapReady))
             return;
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
-        }
-
         //
         // Accept new connections
         //
         BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            socket_events_map_t::const_iterator it = mapReady.find(hListenSocket.socket);
+            if (hListenSocket.socket != INVALID_SOCKET && it != mapReady.end() && (it->second & SOCKET_EVENT_RECV))
             {
                 AcceptConnection(hListenSocket);
             }
@@ -1304,9 +1550,12 @@ void CConnman::ThreadSocketHandler()
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                socket_events_map_t::const_iterator it = mapReady.find(pnode->hSocket);
+                if (it != mapReady.end()) {
+                    recvSet = it->second & SOCKET_EVENT_RECV;
+                    sendSet = it->second & SOCKET_EVENT_SEND;
+                    errorSet = it->second & SOCKET_EVENT_ERROR;
+                }
             }
             if (recvSet || errorSet)
             {
@@ -1341,7 +1590,7 @@ void CConnman::ThreadSocketHandler()
                                     pnode->nProcessQueueSize += nSizeAdded;
                                     pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
                                 }
-                                WakeMessageHandler();
+                                ScheduleMessageHandler(pnode);
                             }
                         }
                         else if (nBytes == 0)
@@ -1457,6 +1706,23 @@ void CConnman::WakeMessageHandler()
     condMsgProc.notify_one();
 }
 
+void CConnman::ScheduleMessageHandler(CNode* pnode)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutexMsgProc);
+        if (pnode->nMsgProcState == CNode::MSGPROC_RUNNING) {
+            pnode->nMsgProcState = CNode::MSGPROC_REQUEUE;
+            return;
+        }
+        if (pnode->nMsgProcState != CNode::MSGPROC_IDLE)
+            return;
+        pnode->nMsgProcState = CNode::MSGPROC_QUEUED;
+        pnode->AddRef();
+        vMsgProcQueue.push_back(pnode);
+    }
+    condMsgProc.notify_one();
+}
+
 
 
 
@@ -2010,52 +2276,73 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     return true;
 }
 
+void CConnman::SweepMessageHandler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutexMsgProc);
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (!fMsgProcWake && now < nMsgProcNextSweep)
+            return;
+        fMsgProcWake = false;
+        nMsgProcNextSweep = now + std::chrono::milliseconds(MESSAGE_HANDLER_SWEEP_INTERVAL);
+    }
+
+    // Give every peer to the message handler threads, so that pings,
+    // inventory trickles and block announcements go out even to peers
+    // that did not send us anything.
+    LOCK(cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, vNodes) {
+        if (!pnode->fDisconnect)
+            ScheduleMessageHandler(pnode);
+    }
+}
+
 void CConnman::ThreadMessageHandler()
 {
     while (!flagInterruptMsgProc)
     {
-        std::vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy) {
-                pnode->AddRef();
-            }
-        }
+        SweepMessageHandler();
 
-        bool fMoreWork = false;
-
-        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+        // Peers are handed out one at a time and only to one thread at a
+        // time, so each peer's messages are still processed in order, while
+        // cheap messages from one peer do not wait behind expensive ones
+        // from another.
+        CNode* pnode;
         {
-            if (pnode->fDisconnect)
+            std::unique_lock<std::mutex> lock(mutexMsgProc);
+            if (vMsgProcQueue.empty()) {
+                condMsgProc.wait_until(lock, nMsgProcNextSweep, [this] { return fMsgProcWake || !vMsgProcQueue.empty() || flagInterruptMsgProc; });
+            }
+            if (vMsgProcQueue.empty())
                 continue;
+            pnode = vMsgProcQueue.front();
+            vMsgProcQueue.pop_front();
+            pnode->nMsgProcState = CNode::MSGPROC_RUNNING;
+        }
 
+        bool fMoreNodeWork = false;
+        if (!pnode->fDisconnect) {
             // Receive messages
-            bool fMoreNodeWork = GetNodeSignals().ProcessMessages(pnode, *this, flagInterruptMsgProc);
-            fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
-            if (flagInterruptMsgProc)
-                return;
+            fMoreNodeWork = GetNodeSignals().ProcessMessages(pnode, *this, flagInterruptMsgProc) && !pnode->fPauseSend;
 
             // Send messages
-            {
+            if (!flagInterruptMsgProc) {
                 LOCK(pnode->cs_sendProcessing);
                 GetNodeSignals().SendMessages(pnode, *this, flagInterruptMsgProc);
             }
-            if (flagInterruptMsgProc)
-                return;
         }
 
         {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
-                pnode->Release();
-        }
-
-        std::unique_lock<std::mutex> lock(mutexMsgProc);
-        if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            std::lock_guard<std::mutex> lock(mutexMsgProc);
+            if ((fMoreNodeWork || pnode->nMsgProcState == CNode::MSGPROC_REQUEUE) && !pnode->fDisconnect) {
+                // Go to the back of the queue, so other peers get their turn
+                pnode->nMsgProcState = CNode::MSGPROC_QUEUED;
+                vMsgProcQueue.push_back(pnode);
+                continue;
+            }
+            pnode->nMsgProcState = CNode::MSGPROC_IDLE;
         }
-        fMsgProcWake = false;
+        pnode->Release();
     }
 }
 
@@ -2063,7 +2350,6 @@ void CConnman::ThreadMessageHandler()
 
 
 
-
 bool CConnman::BindListenPort(const CService &addrBind, std::string& strError, bool fWhitelisted)
 {
     strError = "";
@@ -2251,6 +2537,12 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     nBestHeight = 0;
     clientInterface = NULL;
     flagInterruptMsgProc = false;
+    socketEventsMode = SOCKETEVENTS_SELECT;
+    nMessageHandlerThreads = 1;
+    nSocketWakeups = 0;
+#ifdef USE_EPOLL
+    epollfd = -1;
+#endif
 }
 
 NodeId CConnman::GetNewNodeId()
@@ -2277,6 +2569,19 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
     nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
 
+    socketEventsMode = connOptions.socketEventsMode;
+    nMessageHandlerThreads = std::max(1, std::min(connOptions.nMessageHandlerThreads, MAX_MESSAGE_HANDLER_THREADS));
+#ifdef USE_EPOLL
+    if (socketEventsMode == SOCKETEVENTS_EPOLL) {
+        epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollfd == -1) {
+            LogPrintf("Failed to create epoll instance (%s), falling back to poll\n", NetworkErrorString(WSAGetLastError()));
+            socketEventsMode = SOCKETEVENTS_POLL;
+        }
+    }
+#endif
+    LogPrintf("Using %s for socket events\n", GetSocketEventsModeName(socketEventsMode));
+
     SetBestHeight(connOptions.nBestHeight);
 
     clientInterface = connOptions.uiInterface;
@@ -2336,6 +2641,7 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     {
         std::unique_lock<std::mutex> lock(mutexMsgProc);
         fMsgProcWake = false;
+        nMsgProcNextSweep = std::chrono::steady_clock::now();
     }
 
     // Send and receive from sockets, accept connections
@@ -2354,7 +2660,8 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        threadMessageHandlers.push_back(std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this))));
 
     // Dump network addresses
     scheduler.scheduleEvery(boost::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL);
@@ -2403,8 +2710,18 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : threadMessageHandlers)
+        if (thread.joinable())
+            thread.join();
+    threadMessageHandlers.clear();
+    {
+        std::lock_guard<std::mutex> lock(mutexMsgProc);
+        for (CNode* pnode : vMsgProcQueue) {
+            pnode->nMsgProcState = CNode::MSGPROC_IDLE;
+            pnode->Release();
+        }
+        vMsgProcQueue.clear();
+    }
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2414,6 +2731,14 @@ void CConnman::Stop()
     if (threadSocketHandler.joinable())
         threadSocketHandler.join();
 
+#ifdef USE_EPOLL
+    if (epollfd != -1) {
+        close(epollfd);
+        epollfd = -1;
+    }
+    mapEpollInterest.clear();
+#endif
+
     if (fAddressesInitialized)
     {
         DumpData();
@@ -2760,9 +3085,14 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nProcessQueueSize = 0;
     nPendingHeaderRequests = 0;
 
-    BOOST_FOREACH(const std::string &msg, getAllNetMessageTypes())
+    nMsgProcState = MSGPROC_IDLE;
+
+    BOOST_FOREACH(const std::string &msg, getAllNetMessageTypes()) {
         mapRecvBytesPerMsgCmd[msg] = 0;
+        mapRecvQueueTimePerMsgCmd[msg] = CMsgQueueTime();
+    }
     mapRecvBytesPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
+    mapRecvQueueTimePerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = CMsgQueueTime();
 
     if (fLogIPs)
         LogPrint("net", "Added connection to %s peer=%d\n", addrName, id);
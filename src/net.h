@@ -88,6 +88,28 @@ static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 
+/** -msghandlerthreads default */
+static const int DEFAULT_MESSAGE_HANDLER_THREADS = 4;
+/** Maximum number of message handler threads */
+static const int MAX_MESSAGE_HANDLER_THREADS = 16;
+/** Interval at which every peer is given to a message handler thread, even without new messages (milliseconds) */
+static const int MESSAGE_HANDLER_SWEEP_INTERVAL = 100;
+
+/** How the socket handler waits for socket readiness (-socketevents) */
+enum SocketEventsMode {
+    SOCKETEVENTS_SELECT = 0,
+    SOCKETEVENTS_POLL = 1,
+    SOCKETEVENTS_EPOLL = 2,
+};
+/** -socketevents default: the most scalable backend available on this platform */
+#if defined(USE_EPOLL)
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_EPOLL;
+#elif defined(USE_POLL)
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_POLL;
+#else
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_SELECT;
+#endif
+
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
@@ -147,6 +169,8 @@ public:
         unsigned int nReceiveFloodSize = 0;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
+        SocketEventsMode socketEventsMode = DEFAULT_SOCKETEVENTS;
+        int nMessageHandlerThreads = 1;
     };
     CConnman(uint64_t seed0, uint64_t seed1);
     ~CConnman();
@@ -279,6 +303,10 @@ public:
     uint64_t GetTotalBytesRecv();
     uint64_t GetTotalBytesSent();
 
+    SocketEventsMode GetSocketEventsMode() const { return socketEventsMode; }
+    //! number of times the socket handler returned from waiting for events
+    uint64_t GetSocketWakeups() const { return nSocketWakeups; }
+
     void SetBestHeight(int height);
     int GetBestHeight() const;
 
@@ -289,6 +317,7 @@ public:
 
     void SetMaxConnections(int newMaxConnections);
 
+    /** Give every peer to the message handler threads, e.g. to announce a new tip */
     void WakeMessageHandler();
 private:
     struct ListenSocket {
@@ -302,7 +331,39 @@ private:
     void ProcessOneShot();
     void ThreadOpenConnections();
     void ThreadMessageHandler();
+    /** Queue a peer for the message handler threads, unless it is already queued */
+    void ScheduleMessageHandler(CNode* pnode);
+    /** Queue every peer, if a sweep is due. Requires mutexMsgProc not held. */
+    void SweepMessageHandler();
     void AcceptConnection(const ListenSocket& hListenSocket);
+
+    enum SocketEventFlags {
+        SOCKET_EVENT_RECV = (1U << 0),
+        SOCKET_EVENT_SEND = (1U << 1),
+        SOCKET_EVENT_ERROR = (1U << 2),
+    };
+    /** Events a socket is waited on for, and the node (or -1 for listening sockets) it belongs to */
+    struct SocketInterest {
+        NodeId id;
+        unsigned int nEvents;
+
+        SocketInterest(NodeId id_, unsigned int nEvents_) : id(id_), nEvents(nEvents_) {}
+        bool operator==(const SocketInterest& other) const { return id == other.id && nEvents == other.nEvents; }
+    };
+    typedef std::map<SOCKET, SocketInterest> socket_interest_map_t;
+    typedef std::map<SOCKET, unsigned int> socket_events_map_t;
+
+    void GenerateSocketInterest(socket_interest_map_t& mapInterest);
+    /** Wait for the sockets in mapInterest to become ready, filling mapReady. Returns false if interrupted. */
+    bool SocketEvents(const socket_interest_map_t& mapInterest, socket_events_map_t& mapReady);
+    bool SocketEventsSelect(const socket_interest_map_t& mapInterest, socket_events_map_t& mapReady);
+#ifdef USE_POLL
+    bool SocketEventsPoll(const socket_interest_map_t& mapInterest, socket_events_map_t& mapReady);
+#endif
+#ifdef USE_EPOLL
+    bool SocketEventsEpoll(const socket_interest_map_t& mapInterest, socket_events_map_t& mapReady);
+    void UpdateEpollInterest(const socket_interest_map_t& mapInterest);
+#endif
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -363,6 +424,15 @@ private:
 
     std::vector<ListenSocket> vhListenSocket;
     std::atomic<bool> fNetworkActive;
+
+    SocketEventsMode socketEventsMode;
+    std::atomic<uint64_t> nSocketWakeups;
+#ifdef USE_EPOLL
+    // Only accessed by ThreadSocketHandler. Registrations are kept across
+    // iterations and only changed when a socket's interest changes.
+    int epollfd;
+    socket_interest_map_t mapEpollInterest;
+#endif
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
     bool setBannedIsDirty;
@@ -396,8 +466,13 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
+    /** flag for requesting a sweep over all peers from the message processor. */
     bool fMsgProcWake;
+    /** Peers waiting for a message handler thread, in order. Protected by mutexMsgProc. */
+    std::deque<CNode*> vMsgProcQueue;
+    /** When the next sweep over all peers is due. Protected by mutexMsgProc. */
+    std::chrono::steady_clock::time_point nMsgProcNextSweep;
+    int nMessageHandlerThreads;
 
     std::condition_variable condMsgProc;
     std::mutex mutexMsgProc;
@@ -409,13 +484,18 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 };
 extern std::unique_ptr<CConnman> g_connman;
 void Discover(boost::thread_group& threadGroup);
 void MapPort(bool fUseUPnP);
 unsigned short GetListenPort();
 bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhitelisted = false);
+/** Parse a -socketevents name, failing for backends not compiled in on this platform */
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& mode);
+std::string GetSocketEventsModeName(SocketEventsMode mode);
+/** Comma-separated names of the socket event backends available on this platform */
+std::string GetSupportedSocketEventsModes();
 
 struct CombinerAll
 {
@@ -488,6 +568,17 @@ extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 typedef std::map<std::string, uint64_t> mapMsgCmdSize; //command, total bytes
 
+/** How long messages of one command waited between being received and being processed */
+struct CMsgQueueTime
+{
+    uint64_t nCount;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+
+    CMsgQueueTime() : nCount(0), nTotalMicros(0), nMaxMicros(0) {}
+};
+typedef std::map<std::string, CMsgQueueTime> mapMsgCmdQueueTime;
+
 class CNodeStats
 {
 public:
@@ -508,6 +599,7 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdQueueTime mapRecvQueueTimePerMsgCmd;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -587,6 +679,16 @@ public:
     std::list<CNetMessage> vProcessMsg;
     size_t nProcessQueueSize;
 
+    enum MsgProcState {
+        MSGPROC_IDLE,       //!< not waiting for a message handler thread
+        MSGPROC_QUEUED,     //!< in CConnman::vMsgProcQueue
+        MSGPROC_RUNNING,    //!< being processed by a message handler thread
+        MSGPROC_REQUEUE,    //!< being processed, and to be queued again afterwards
+    };
+    // Protected by CConnman::mutexMsgProc. Ensures that only one message
+    // handler thread processes this peer at a time, keeping its messages in order.
+    MsgProcState nMsgProcState;
+
     CCriticalSection cs_sendProcessing;
 
     std::deque<CInv> vRecvGetData;
@@ -632,12 +734,16 @@ protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdQueueTime mapRecvQueueTimePerMsgCmd;
 
 public:
     uint256 hashContinue;
     std::atomic<int> nStartingHeight;
 
     // flood relay
+    // vAddrToSend and addrKnown are protected by cs_addrSend, as other peers'
+    // message handler threads relay addresses to us.
+    CCriticalSection cs_addrSend;
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -738,6 +844,8 @@ public:
     }
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    /** Account for a message of strCommand that waited nQueueMicros before being processed */
+    void RecordRecvQueueTime(const std::string& strCommand, int64_t nQueueMicros);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -769,6 +877,7 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_addrSend);
         addrKnown.insert(_addr.GetKey());
     }
 
@@ -777,6 +886,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_addrSend);
         if (_addr.IsValid() && !addrKnown.contains(_addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand.rand32() % vAddrToSend.size()] = _addr;
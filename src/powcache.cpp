@@ -0,0 +1,89 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "powcache.h"
+
+#include "consensus/params.h"
+#include "cuckoocache.h"
+#include "hash.h"
+#include "lebowskiscoin.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "uint256.h"
+#include "util.h"
+#include "version.h"
+
+#include <boost/thread.hpp>
+
+namespace {
+
+/**
+ * Cache of block headers whose proof of work has been verified.
+ */
+class CPowCache
+{
+private:
+    //! Entries are SHA256d(nonce || consensus parameters || header || auxpow)
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_powcache;
+
+public:
+    CPowCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const CBlockHeader& block, const Consensus::Params& params)
+    {
+        // Only the parameters CheckAuxPowProofOfWork() depends on
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << nonce << params.powLimit << params.fStrictChainId << params.nAuxpowChainId << block;
+        entry = ss.GetHash();
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_powcache);
+        return setValid.contains(entry, false);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_powcache);
+        setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        return setValid.setup_bytes(n);
+    }
+};
+
+static CPowCache powCache;
+static bool fRecheckPow = DEFAULT_RECHECK_POW;
+}
+
+void InitPowCache()
+{
+    fRecheckPow = GetBoolArg("-recheckpow", DEFAULT_RECHECK_POW);
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxpowcachesize", DEFAULT_MAX_POW_CACHE_SIZE)), MAX_MAX_POW_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = powCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for proof-of-work cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+bool CheckAuxPowProofOfWorkCached(const CBlockHeader& block, const Consensus::Params& params, const uint256* pPowHash)
+{
+    uint256 entry;
+    powCache.ComputeEntry(entry, block, params);
+    if (!fRecheckPow && powCache.Get(entry))
+        return true;
+    if (!CheckAuxPowProofOfWork(block, params, pPowHash))
+        return false;
+    powCache.Set(entry);
+    return true;
+}
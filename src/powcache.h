@@ -0,0 +1,34 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_POWCACHE_H
+#define BITCOIN_POWCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class CBlockHeader;
+class uint256;
+
+namespace Consensus { struct Params; }
+
+/** Default for -maxpowcachesize, the size of the verified proof-of-work cache (MiB) */
+static const int64_t DEFAULT_MAX_POW_CACHE_SIZE = 16;
+/** Maximum -maxpowcachesize */
+static const int64_t MAX_MAX_POW_CACHE_SIZE = 1024;
+/** Default for -recheckpow, whether to bypass the proof-of-work cache */
+static const bool DEFAULT_RECHECK_POW = false;
+
+/** To be called once in AppInit2/TestingSetup to initialize the proof-of-work cache */
+void InitPowCache();
+
+/**
+ * CheckAuxPowProofOfWork() backed by a salted cache of headers (including
+ * their auxpow) that already passed it with the same consensus parameters.
+ * Blocks read back from disk were checked when they were accepted, so with
+ * the cache re-reading them for peers, RPC or VerifyDB costs no scrypt.
+ */
+bool CheckAuxPowProofOfWorkCached(const CBlockHeader& block, const Consensus::Params& params, const uint256* pPowHash = NULL);
+
+#endif // BITCOIN_POWCACHE_H
@@ -17,6 +17,7 @@
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -29,6 +30,8 @@
 
 #include <univalue.h>
 
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
 #include <boost/thread/thread.hpp> // boost::thread::interrupt
 
 #include <mutex>
@@ -746,51 +749,6 @@ static CBlock GetBlockChecked(const CBlockIndex* pblockindex)
     return block;
 }
 
-template<typename T>
-static T CalculateTruncatedMedian(std::vector<T>& scores)
-{
-    size_t size = scores.size();
-    if (size == 0) {
-        return 0;
-    }
-
-    std::sort(scores.begin(), scores.end());
-    if (size % 2 == 0) {
-        return (scores[size / 2 - 1] + scores[size / 2]) / 2;
-    } else {
-        return scores[size / 2];
-    }
-}
-
-void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight)
-{
-    if (scores.empty()) {
-        return;
-    }
-
-    std::sort(scores.begin(), scores.end());
-
-    // 10th, 25th, 50th, 75th, and 90th percentile weight units.
-    const double weights[NUM_GETBLOCKSTATS_PERCENTILES] = {
-            total_weight / 10.0, total_weight / 4.0, total_weight / 2.0, (total_weight * 3.0) / 4.0, (total_weight * 9.0) / 10.0
-    };
-
-    int64_t next_percentile_index = 0;
-    int64_t cumulative_weight = 0;
-    for (const auto& element : scores) {
-        cumulative_weight += element.second;
-        while (next_percentile_index < NUM_GETBLOCKSTATS_PERCENTILES && cumulative_weight >= weights[next_percentile_index]) {
-            result[next_percentile_index] = element.first;
-            ++next_percentile_index;
-        }
-    }
-
-    // Fill any remaining percentiles with the last value.
-    for (int64_t i = next_percentile_index; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
-        result[i] = scores.back().first;
-    }
-}
-
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to read
@@ -835,223 +793,172 @@ static CBlockUndo GetUndoChecked(const CBlockIndex* pblockindex)
     return blockUndo;
 }
 
-template<typename T>
-static inline bool SetHasKeys(const std::set<T>& set) {return false;}
-template<typename T, typename Tk, typename... Args>
-static inline bool SetHasKeys(const std::set<T>& set, const Tk& key, const Args&... args)
+/**
+ * Get the statistics of a block, from -blockstatsindex if it has them.
+ * cs_main is only held to look them up, not while reading the block.
+ */
+static CBlockStats GetBlockStatsChecked(const CBlockIndex* pindex)
 {
-    return (set.count(key) != 0) || SetHasKeys(set, args...);
-}
+    CBlockStats blockstats;
+    {
+        LOCK(cs_main);
+        if (fBlockStatsIndex && pblocktree->ReadBlockStats(pindex->nHeight, blockstats) && blockstats.hashBlock == pindex->GetBlockHash())
+            return blockstats;
+        if (fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA) && pindex->nTx > 0)
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+    }
 
-// outpoint (needed for the utxo index) + nHeight + fCoinBase
-static constexpr size_t PER_UTXO_OVERHEAD = sizeof(COutPoint) + sizeof(uint32_t) + sizeof(bool);
+    const CBlock block = GetBlockChecked(pindex);
+    const CBlockUndo blockUndo = GetUndoChecked(pindex);
+    ComputeBlockStats(block, pindex, blockUndo, blockstats);
 
-UniValue getblockstats(const JSONRPCRequest& request) {
-    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
-        throw runtime_error(
-                "getblockstats \"hash_or_height\" ( stats )\n"
-        );
+    // Fill in blocks connected before the index was enabled
+    if (fBlockStatsIndex) {
+        LOCK(cs_main);
+        if (chainActive.Contains(pindex))
+            pblocktree->WriteBlockStats(blockstats);
+    }
+    return blockstats;
+}
 
-    LOCK(cs_main);
+static UniValue BlockStatsToJSON(const CBlockStats& blockstats, const std::set<std::string>& stats)
+{
+    UniValue feerates_res(UniValue::VARR);
+    for (int64_t i = 0; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
+      feerates_res.push_back(blockstats.vFeeRatePercentiles[i]);
+    }
 
-    CBlockIndex* pindex;
-    if (request.params[0].isNum()) {
-      const int height = request.params[0].get_int();
-      const int current_tip = chainActive.Height();
-      if (height < 0) {
-          throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
-      }
+    UniValue ret_all(UniValue::VOBJ);
+    ret_all.pushKV("avgfee", (blockstats.nTxs > 1) ? blockstats.nTotalFee / (blockstats.nTxs - 1) : 0);
+    ret_all.pushKV("avgfeerate", blockstats.nTotalWeight ? (blockstats.nTotalFee * WITNESS_SCALE_FACTOR) / blockstats.nTotalWeight : 0); // Unit: sat/vbyte
+    ret_all.pushKV("avgtxsize", (blockstats.nTxs > 1) ? blockstats.nTotalSize / (blockstats.nTxs - 1) : 0);
+    ret_all.pushKV("blockhash", blockstats.hashBlock.GetHex());
+    ret_all.pushKV("feerate_percentiles", feerates_res);
+    ret_all.pushKV("height", (int64_t)blockstats.nHeight);
+    ret_all.pushKV("ins", blockstats.nIns);
+    ret_all.pushKV("maxfee", blockstats.nMaxFee);
+    ret_all.pushKV("maxfeerate", blockstats.nMaxFeeRate);
+    ret_all.pushKV("maxtxsize", blockstats.nMaxTxSize);
+    ret_all.pushKV("medianfee", blockstats.nMedianFee);
+    ret_all.pushKV("mediantime", blockstats.nMedianTime);
+    ret_all.pushKV("mediantxsize", blockstats.nMedianTxSize);
+    ret_all.pushKV("minfee", blockstats.nMinFee);
+    ret_all.pushKV("minfeerate", blockstats.nMinFeeRate);
+    ret_all.pushKV("mintxsize", blockstats.nMinTxSize);
+    ret_all.pushKV("outs", blockstats.nOuts);
+    ret_all.pushKV("subsidy", GetDogecoinBlockSubsidy(blockstats.nHeight, 0, Params().GetConsensus(blockstats.nHeight), blockstats.hashPrevBlock));
+    ret_all.pushKV("swtotal_size", blockstats.nSwTotalSize);
+    ret_all.pushKV("swtotal_weight", blockstats.nSwTotalWeight);
+    ret_all.pushKV("swtxs", blockstats.nSwTxs);
+    ret_all.pushKV("time", blockstats.nTime);
+    ret_all.pushKV("total_out", blockstats.nTotalOut);
+    ret_all.pushKV("total_size", blockstats.nTotalSize);
+    ret_all.pushKV("total_weight", blockstats.nTotalWeight);
+    ret_all.pushKV("totalfee", blockstats.nTotalFee);
+    ret_all.pushKV("txs", blockstats.nTxs);
+    ret_all.pushKV("utxo_increase", blockstats.nOuts - blockstats.nIns);
+    ret_all.pushKV("utxo_size_inc", blockstats.nUtxoSizeInc);
+
+    if (stats.empty()) { // Return everything if nothing selected (default)
+      return ret_all;
+    }
 
-      if (height > current_tip) {
-          throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
+    UniValue ret(UniValue::VOBJ);
+    for (const std::string& stat : stats) {
+      const UniValue& value = ret_all[stat];
+      if (value.isNull()) {
+          throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid selected statistic %s", stat));
       }
+      ret.pushKV(stat, value);
+    }
 
-      //pindex = pindexBestHeader;
-      pindex = chainActive[height];
-    } else {
-      const uint256 hash(ParseHashV(request.params[0], "hash_or_height"));
-      pindex = mapBlockIndex[hash];
-      if (mapBlockIndex.count(hash) == 0) {
-          throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-      }
+    return ret;
+}
+
+static int ParseBlockStatsHeight(const UniValue& param)
+{
+    // The command line client passes the first argument as a string, as it may be a hash
+    int height;
+    if (param.isNum()) {
+        height = param.get_int();
+    } else if (!ParseInt32(param.get_str(), &height)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height " + param.get_str());
+    }
+    if (height < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
     }
 
-    if(pindex == nullptr) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    LOCK(cs_main);
+    const int current_tip = chainActive.Height();
+    if (height > current_tip) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
     }
+    return height;
+}
+
+UniValue getblockstats(const JSONRPCRequest& request) {
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw runtime_error(
+                "getblockstats \"hash_or_height\" ( stats )\n"
+                "getblockstats start_height end_height ( stats )\n"
+                "\nCompute per block statistics for a given block, or for each block of the\n"
+                "active chain from start_height to end_height. They are read from the\n"
+                "-blockstatsindex if enabled, otherwise from the block and its undo data.\n"
+        );
 
     std::set<std::string> stats;
-    if (!request.params[1].isNull()) {
-      const UniValue stats_univalue = request.params[1].get_array();
+    const bool fRange = request.params.size() > 1 && request.params[1].isNum();
+    const size_t nStatsParam = fRange ? 2 : 1;
+    if (request.params.size() > nStatsParam && !request.params[nStatsParam].isNull()) {
+      const UniValue stats_univalue = request.params[nStatsParam].get_array();
       for (unsigned int i = 0; i < stats_univalue.size(); i++) {
           const std::string stat = stats_univalue[i].get_str();
           stats.insert(stat);
       }
     }
 
-    const CBlock block = GetBlockChecked(pindex);
-    const CBlockUndo blockUndo = GetUndoChecked(pindex);
-
-    const bool do_all = stats.size() == 0; // Calculate everything if nothing selected (default)
-    const bool do_mediantxsize = do_all || stats.count("mediantxsize") != 0;
-    const bool do_medianfee = do_all || stats.count("medianfee") != 0;
-    const bool do_feerate_percentiles = do_all || stats.count("feerate_percentiles") != 0;
-    const bool loop_inputs = do_all || do_medianfee || do_feerate_percentiles ||
-                           SetHasKeys(stats, "utxo_size_inc", "totalfee", "avgfee", "avgfeerate", "minfee", "maxfee", "minfeerate", "maxfeerate");
-    const bool loop_outputs = do_all || loop_inputs || stats.count("total_out");
-    const bool do_calculate_size = do_mediantxsize ||
-                                 SetHasKeys(stats, "total_size", "avgtxsize", "mintxsize", "maxtxsize", "swtotal_size");
-    const bool do_calculate_weight = do_all || SetHasKeys(stats, "total_weight", "avgfeerate", "swtotal_weight", "avgfeerate", "feerate_percentiles", "minfeerate", "maxfeerate");
-    const bool do_calculate_sw = do_all || SetHasKeys(stats, "swtxs", "swtotal_size", "swtotal_weight");
-
-    CAmount maxfee = 0;
-    CAmount maxfeerate = 0;
-    CAmount minfee = MAX_MONEY;
-    CAmount minfeerate = MAX_MONEY;
-    CAmount total_out = 0;
-    CAmount totalfee = 0;
-    int64_t inputs = 0;
-    int64_t maxtxsize = 0;
-    int64_t mintxsize = MAX_BLOCK_SERIALIZED_SIZE;
-    int64_t outputs = 0;
-    int64_t swtotal_size = 0;
-    int64_t swtotal_weight = 0;
-    int64_t swtxs = 0;
-    int64_t total_size = 0;
-    int64_t total_weight = 0;
-    int64_t utxo_size_inc = 0;
-    std::vector<CAmount> fee_array;
-    std::vector<std::pair<CAmount, int64_t>> feerate_array;
-    std::vector<int64_t> txsize_array;
-
-    for (size_t i = 0; i < block.vtx.size(); ++i) {
-      const auto& tx = block.vtx.at(i);
-      outputs += tx->vout.size();
-
-      CAmount tx_total_out = 0;
-      if (loop_outputs) {
-          for (const CTxOut& out : tx->vout) {
-              tx_total_out += out.nValue;
-              utxo_size_inc += GetSerializeSize(out, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
-          }
-      }
-
-      if (tx->IsCoinBase()) {
-          continue;
+    if (fRange) {
+      const int start_height = ParseBlockStatsHeight(request.params[0]);
+      const int end_height = ParseBlockStatsHeight(request.params[1]);
+      if (end_height < start_height) {
+          throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("End height %d before start height %d", end_height, start_height));
       }
 
-      inputs += tx->vin.size(); // Don't count coinbase's fake input
-      total_out += tx_total_out; // Don't count coinbase reward
-
-      int64_t tx_size = 0;
-      if (do_calculate_size) {
-
-          tx_size = tx->GetTotalSize();
-          if (do_mediantxsize) {
-              txsize_array.push_back(tx_size);
+      UniValue ret(UniValue::VARR);
+      for (int height = start_height; height <= end_height; height++) {
+          const CBlockIndex* pindex;
+          {
+              LOCK(cs_main);
+              pindex = chainActive[height];
           }
-          maxtxsize = std::max(maxtxsize, tx_size);
-          mintxsize = std::min(mintxsize, tx_size);
-          total_size += tx_size;
-      }
-
-      int64_t weight = 0;
-      if (do_calculate_weight) {
-          weight = GetTransactionWeight(*tx);
-          total_weight += weight;
-      }
-
-      if (do_calculate_sw && tx->HasWitness()) {
-          ++swtxs;
-          swtotal_size += tx_size;
-          swtotal_weight += weight;
-      }
-
-      if (loop_inputs) {
-          CAmount tx_total_in = 0;
-          const auto& txundo = blockUndo.vtxundo.at(i - 1);
-          for (const CTxInUndo& prevoutput: txundo.vprevout) {
-
-              tx_total_in += prevoutput.txout.nValue;
-              utxo_size_inc -= GetSerializeSize(prevoutput, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
-          }
-
-          CAmount txfee = tx_total_in - tx_total_out;
-          //CHECK_NONFATAL(MoneyRange(txfee));
-
-          if(MoneyRange(txfee)) {
-              if (do_medianfee) {
-                  fee_array.push_back(txfee);
-              }
-
-              maxfee = std::max(maxfee, txfee);
-              minfee = std::min(minfee, txfee);
-              totalfee += txfee;
-
-              // New feerate uses satoshis per virtual byte instead of per serialized byte
-              CAmount feerate = weight ? (txfee * WITNESS_SCALE_FACTOR) / weight : 0;
-              if (do_feerate_percentiles) {
-                  feerate_array.emplace_back(std::make_pair(feerate, weight));
-              }
-              maxfeerate = std::max(maxfeerate, feerate);
-              minfeerate = std::min(minfeerate, feerate);
+          if (pindex == nullptr) {
+              throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
           }
+          ret.push_back(BlockStatsToJSON(GetBlockStatsChecked(pindex), stats));
       }
+      return ret;
     }
 
-    CAmount feerate_percentiles[NUM_GETBLOCKSTATS_PERCENTILES] = { 0 };
-    CalculatePercentilesByWeight(feerate_percentiles, feerate_array, total_weight);
-
-    UniValue feerates_res(UniValue::VARR);
-    for (int64_t i = 0; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
-      feerates_res.push_back(feerate_percentiles[i]);
-    }
-
-    UniValue ret_all(UniValue::VOBJ);
-    ret_all.pushKV("avgfee", (block.vtx.size() > 1) ? totalfee / (block.vtx.size() - 1) : 0);
-    ret_all.pushKV("avgfeerate", total_weight ? (totalfee * WITNESS_SCALE_FACTOR) / total_weight : 0); // Unit: sat/vbyte
-    ret_all.pushKV("avgtxsize", (block.vtx.size() > 1) ? total_size / (block.vtx.size() - 1) : 0);
-    ret_all.pushKV("blockhash", pindex->GetBlockHash().GetHex());
-    ret_all.pushKV("feerate_percentiles", feerates_res);
-    ret_all.pushKV("height", (int64_t)pindex->nHeight);
-    ret_all.pushKV("ins", inputs);
-    ret_all.pushKV("maxfee", maxfee);
-    ret_all.pushKV("maxfeerate", maxfeerate);
-    ret_all.pushKV("maxtxsize", maxtxsize);
-    ret_all.pushKV("medianfee", CalculateTruncatedMedian(fee_array));
-    ret_all.pushKV("mediantime", pindex->GetMedianTimePast());
-    ret_all.pushKV("mediantxsize", CalculateTruncatedMedian(txsize_array));
-    ret_all.pushKV("minfee", (minfee == MAX_MONEY) ? 0 : minfee);
-    ret_all.pushKV("minfeerate", (minfeerate == MAX_MONEY) ? 0 : minfeerate);
-    ret_all.pushKV("mintxsize", mintxsize == MAX_BLOCK_SERIALIZED_SIZE ? 0 : mintxsize);
-    ret_all.pushKV("outs", outputs);
-    ret_all.pushKV("subsidy", GetDogecoinBlockSubsidy(pindex->nHeight, 0, Params().GetConsensus(pindex->nHeight), block.hashPrevBlock));
-    ret_all.pushKV("swtotal_size", swtotal_size);
-    ret_all.pushKV("swtotal_weight", swtotal_weight);
-    ret_all.pushKV("swtxs", swtxs);
-    ret_all.pushKV("time", pindex->GetBlockTime());
-    ret_all.pushKV("total_out", total_out);
-    ret_all.pushKV("total_size", total_size);
-    ret_all.pushKV("total_weight", total_weight);
-    ret_all.pushKV("totalfee", totalfee);
-    ret_all.pushKV("txs", (int64_t)block.vtx.size());
-    ret_all.pushKV("utxo_increase", outputs - inputs);
-    ret_all.pushKV("utxo_size_inc", utxo_size_inc);
-
-    if (do_all) {
-      return ret_all;
+    CBlockIndex* pindex;
+    if (request.params[0].isNum()) {
+      const int height = ParseBlockStatsHeight(request.params[0]);
+      LOCK(cs_main);
+      pindex = chainActive[height];
+    } else {
+      const uint256 hash(ParseHashV(request.params[0], "hash_or_height"));
+      LOCK(cs_main);
+      BlockMap::iterator it = mapBlockIndex.find(hash);
+      if (it == mapBlockIndex.end()) {
+          throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+      }
+      pindex = it->second;
     }
 
-    UniValue ret(UniValue::VOBJ);
-    for (const std::string& stat : stats) {
-      const UniValue& value = ret_all[stat];
-      if (value.isNull()) {
-          throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid selected statistic %s", stat));
-      }
-      ret.pushKV(stat, value);
+    if(pindex == nullptr) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
     }
 
-    return ret;
+    return BlockStatsToJSON(GetBlockStatsChecked(pindex), stats);
 }
 
 
@@ -1122,6 +1029,17 @@ UniValue getblock(const JSONRPCRequest& request)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
 
+    if (verbosity <= 0 && IsStoredBlockSerialization(pblockindex, RPCSerializationFlags()))
+    {
+        // Hex encode the block as stored, without deserializing it
+        std::vector<unsigned char> vchBlock;
+        if (!ReadRawBlockFromDisk(vchBlock, pblockindex, Params().MessageStart()))
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+        std::string strHex(2 * vchBlock.size(), '\0');
+        HexEncode(&strHex[0], vchBlock.data(), vchBlock.size());
+        return strHex;
+    }
+
     if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus(pblockindex->nHeight)))
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
@@ -1141,19 +1059,6 @@ UniValue getblock(const JSONRPCRequest& request)
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
-struct CCoinsStats
-{
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint64_t nSerializedSize;
-    uint256 hashSerialized;
-    arith_uint256 nTotalAmount;
-
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
-};
-
 //! Calculate statistics about the unspent transaction output set
 static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
 {
@@ -1166,32 +1071,32 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
     }
     ss << stats.hashBlock;
-    arith_uint256 nTotalAmount = 0;
+    // Outputs of a transaction are adjacent; hash them as one record per
+    // transaction, as when the set was stored per transaction
+    uint256 prevkey;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        uint256 key;
-        CCoins coins;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coins)) {
-            stats.nTransactions++;
-            ss << key;
-            for (unsigned int i=0; i<coins.vout.size(); i++) {
-                const CTxOut &out = coins.vout[i];
-                if (!out.IsNull()) {
-                    stats.nTransactionOutputs++;
-                    ss << VARINT(i+1);
-                    ss << out;
-                    nTotalAmount += out.nValue;
-                }
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (stats.nTransactionOutputs == 0 || key.hash != prevkey) {
+                if (stats.nTransactionOutputs != 0)
+                    ss << VARINT(0);
+                stats.nTransactions++;
+                ss << key.hash;
+                prevkey = key.hash;
             }
-            stats.nSerializedSize += 32 + pcursor->GetValueSize();
-            ss << VARINT(0);
+            ss << VARINT(key.n+1);
+            ss << coin.out;
+            stats.Add(key, coin, pcursor->GetValueSize());
         } else {
             return error("%s: unable to read value", __func__);
         }
         pcursor->Next();
     }
+    if (stats.nTransactionOutputs != 0)
+        ss << VARINT(0);
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
     return true;
 }
 
@@ -1246,37 +1151,70 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
 
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"mode\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
             "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"mode\"      (string, optional, default=\"full\") How to compute the statistics:\n"
+            "                 \"full\" scans and hashes the whole set,\n"
+            "                 \"parallel\" scans it on several threads, without hash_serialized,\n"
+            "                 \"incremental\" returns the totals kept up to date with -utxostatsindex, without hash_serialized\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs (not in \"incremental\" mode)\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash (\"full\" mode only)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"parallel\"")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
+    std::string strMode = "full";
+    if (request.params.size() > 0 && !request.params[0].isNull())
+        strMode = request.params[0].get_str();
+
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (GetUTXOStats(pcoinsTip, stats)) {
+    bool fRead;
+    if (strMode == "full") {
+        FlushStateToDisk();
+        fRead = GetUTXOStats(pcoinsTip, stats);
+    } else if (strMode == "parallel") {
+        FlushStateToDisk();
+        CCoinsViewDBSnapshot snapshot(*pcoinsdbview);
+        fRead = snapshot.GetStats(stats, GetNumCores());
+        LOCK(cs_main);
+        BlockMap::iterator it = mapBlockIndex.find(stats.hashBlock);
+        if (it != mapBlockIndex.end())
+            stats.nHeight = it->second->nHeight;
+    } else if (strMode == "incremental") {
+        if (!GetBoolArg("-utxostatsindex", DEFAULT_UTXOSTATSINDEX))
+            throw JSONRPCError(RPC_MISC_ERROR, "UTXO statistics index not enabled (start with -utxostatsindex)");
+        if (!GetUTXOStatsIncremental(stats))
+            throw JSONRPCError(RPC_MISC_ERROR, "UTXO statistics index is still being built");
+        fRead = true;
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode: " + strMode);
+    }
+
+    if (fRead) {
         ret.pushKV("height", (int64_t)stats.nHeight);
         ret.pushKV("bestblock", stats.hashBlock.GetHex());
-        ret.pushKV("transactions", (int64_t)stats.nTransactions);
+        if (strMode != "incremental")
+            ret.pushKV("transactions", (int64_t)stats.nTransactions);
         ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
         ret.pushKV("bytes_serialized", (int64_t)stats.nSerializedSize);
-        ret.pushKV("hash_serialized", stats.hashSerialized.GetHex());
+        if (strMode == "full")
+            ret.pushKV("hash_serialized", stats.hashSerialized.GetHex());
         ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
     } else {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
@@ -1309,7 +1247,6 @@ UniValue gettxout(const JSONRPCRequest& request)
             "        ,...\n"
             "     ]\n"
             "  },\n"
-            "  \"version\" : n,            (numeric) The version\n"
             "  \"coinbase\" : true|false   (boolean) Coinbase or not\n"
             "}\n"
 
@@ -1333,33 +1270,35 @@ UniValue gettxout(const JSONRPCRequest& request)
     if (request.params.size() > 2)
         fMempool = request.params[2].get_bool();
 
-    CCoins coins;
+    if (n < 0)
+        return NullUniValue;
+    COutPoint out(hash, n);
+
+    Coin coin;
     if (fMempool) {
         LOCK(mempool.cs);
         CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
+        if (!view.GetCoin(out, coin) || mempool.isSpent(out)) // TODO: filtering spent coins should be done by the CCoinsViewMemPool
             return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
     } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
+        if (!pcoinsTip->GetCoin(out, coin))
             return NullUniValue;
     }
-    if (n<0 || (unsigned int)n>=coins.vout.size() || coins.vout[n].IsNull())
+    if (coin.IsSpent())
         return NullUniValue;
 
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     CBlockIndex *pindex = it->second;
     ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
-    if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
+    if (coin.nHeight == MEMPOOL_HEIGHT)
         ret.pushKV("confirmations", 0);
     else
-        ret.pushKV("confirmations", pindex->nHeight - coins.nHeight + 1);
-    ret.pushKV("value", ValueFromAmount(coins.vout[n].nValue));
+        ret.pushKV("confirmations", (int64_t)(pindex->nHeight - coin.nHeight + 1));
+    ret.pushKV("value", ValueFromAmount(coin.out.nValue));
     UniValue o(UniValue::VOBJ);
-    ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
+    ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
     ret.pushKV("scriptPubKey", o);
-    ret.pushKV("version", coins.nVersion);
-    ret.pushKV("coinbase", coins.fCoinBase);
+    ret.pushKV("coinbase", (bool)coin.fCoinBase);
 
     return ret;
 }
@@ -1705,6 +1644,138 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+UniValue getcoincacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getcoincacheinfo\n"
+            "\nReturns details on the in-memory cache of the UTXO set.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": xxxxx,            (numeric) Number of cached transaction outputs (including spent ones not yet written)\n"
+            "  \"usage\": xxxxx,              (numeric) Memory usage of the cache\n"
+            "  \"maxusage\": xxxxx,           (numeric) Memory usage at which the cache is written to disk (plus unused mempool space)\n"
+            "  \"keeppercent\": xxxxx,        (numeric) Percentage of the cache space kept cached after writing it to disk\n"
+            "  \"flushingusage\": xxxxx,      (numeric) Memory usage of the entries still being written in the background\n"
+            "  \"hits\": xxxxx,               (numeric) Lookups answered from the cache since startup\n"
+            "  \"misses\": xxxxx,             (numeric) Lookups that had to go to the coin database since startup\n"
+            "  \"hitrate\": x.xxx             (numeric) hits / (hits + misses)\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcoincacheinfo", "")
+            + HelpExampleRpc("getcoincacheinfo", "")
+        );
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VOBJ);
+    uint64_t nHits = pcoinsTip->GetCacheHits();
+    uint64_t nMisses = pcoinsTip->GetCacheMisses();
+    ret.pushKV("entries", (int64_t) pcoinsTip->GetCacheSize());
+    ret.pushKV("usage", (int64_t) pcoinsTip->DynamicMemoryUsage());
+    ret.pushKV("maxusage", (int64_t) nCoinCacheUsage);
+    ret.pushKV("keeppercent", nCoinCacheKeep);
+    ret.pushKV("flushingusage", (int64_t) pcoinsdbview->FlushingMemoryUsage());
+    ret.pushKV("hits", (int64_t) nHits);
+    ret.pushKV("misses", (int64_t) nMisses);
+    ret.pushKV("hitrate", nHits + nMisses > 0 ? (double) nHits / (nHits + nMisses) : 0.0);
+    return ret;
+}
+
+static UniValue DBInfoToJSON(const CDBWrapper& db)
+{
+    UniValue ret(UniValue::VOBJ);
+    const CDBOptions& dbopts = db.GetDBOptions();
+    UniValue options(UniValue::VOBJ);
+    options.pushKV("compression", dbopts.fCompression ? "snappy" : "none");
+    options.pushKV("maxopenfiles", dbopts.nMaxOpenFiles);
+    options.pushKV("maxfilesize", dbopts.nMaxFileSize);
+    options.pushKV("bloombits", dbopts.nBloomBits);
+    ret.pushKV("options", options);
+
+    std::string strValue;
+    if (db.GetProperty("leveldb.approximate-memory-usage", strValue))
+        ret.pushKV("memoryusage", atoi64(strValue));
+
+    // A point lookup may have to consult every level 0 file, which can
+    // overlap, plus one file in each deeper level that is not empty.
+    int nFiles = 0, nReadAmplification = 0;
+    for (int nLevel = 0; db.GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel), strValue); nLevel++) {
+        int nLevelFiles = atoi(strValue);
+        nFiles += nLevelFiles;
+        nReadAmplification += nLevel == 0 ? nLevelFiles : (nLevelFiles > 0);
+    }
+    ret.pushKV("files", nFiles);
+    ret.pushKV("readamplification", nReadAmplification);
+
+    UniValue levels(UniValue::VARR);
+    if (db.GetProperty("leveldb.stats", strValue)) {
+        std::vector<std::string> vLines;
+        boost::split(vLines, strValue, boost::is_any_of("\n"));
+        for (const std::string& strLine : vLines) {
+            int nLevel, nLevelFiles;
+            double dSize, dTime, dRead, dWrite;
+            if (sscanf(strLine.c_str(), "%d %d %lf %lf %lf %lf", &nLevel, &nLevelFiles, &dSize, &dTime, &dRead, &dWrite) != 6)
+                continue;
+            UniValue level(UniValue::VOBJ);
+            level.pushKV("level", nLevel);
+            level.pushKV("files", nLevelFiles);
+            level.pushKV("size", dSize);
+            level.pushKV("compactiontime", dTime);
+            level.pushKV("compactionread", dRead);
+            level.pushKV("compactionwrite", dWrite);
+            levels.push_back(level);
+        }
+    }
+    ret.pushKV("levels", levels);
+    return ret;
+}
+
+UniValue getdbinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getdbinfo\n"
+            "\nReturns LevelDB statistics of the chain state and block index databases.\n"
+            "The block index database also holds the transaction index (-txindex).\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"chainstate\": {                (json object) The chain state database\n"
+            "    \"options\": {                 (json object) Tuning in use, see -chainstatedb\n"
+            "      \"compression\": \"xxxx\",     (string) \"none\" or \"snappy\"\n"
+            "      \"maxopenfiles\": xxxxx,     (numeric) Table files kept open\n"
+            "      \"maxfilesize\": xxxxx,      (numeric) Target size of a table file in MiB\n"
+            "      \"bloombits\": xxxxx         (numeric) Bloom filter bits per key\n"
+            "    },\n"
+            "    \"memoryusage\": xxxxx,        (numeric) Approximate memory used by LevelDB caches and write buffers\n"
+            "    \"files\": xxxxx,              (numeric) Number of table files\n"
+            "    \"readamplification\": xxxxx,  (numeric) Table files a lookup may have to read in the worst case\n"
+            "    \"levels\": [                  (array) Compaction stats of the levels in use\n"
+            "      {\n"
+            "        \"level\": xxxxx,          (numeric) Level number\n"
+            "        \"files\": xxxxx,          (numeric) Number of table files\n"
+            "        \"size\": xxxxx,           (numeric) Size of the level in MiB\n"
+            "        \"compactiontime\": xxxxx, (numeric) Seconds spent compacting into the level\n"
+            "        \"compactionread\": xxxxx, (numeric) MiB read by those compactions\n"
+            "        \"compactionwrite\": xxxxx (numeric) MiB written by those compactions\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  },\n"
+            "  \"blockindex\": {                (json object) The block index database, same fields as chainstate\n"
+            "    ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbinfo", "")
+            + HelpExampleRpc("getdbinfo", "")
+        );
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("chainstate", DBInfoToJSON(pcoinsdbview->GetDB()));
+    ret.pushKV("blockindex", DBInfoToJSON(*pblocktree));
+    return ret;
+}
+
 UniValue preciousblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1829,6 +1900,8 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         true,  {"blockhash","verbose"} },
     { "blockchain",         "getchaintips",           &getchaintips,           true,  {} },
+    { "blockchain",         "getcoincacheinfo",       &getcoincacheinfo,       true,  {} },
+    { "blockchain",         "getdbinfo",              &getdbinfo,              true,  {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,  {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,  {"txid","verbose"} },
@@ -1836,7 +1909,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {"mode"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        true,  {"height"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"checklevel","nblocks"} },
 
@@ -116,7 +116,7 @@ UniValue generateBlocks(boost::shared_ptr<CReserveScript> coinbaseScript, int nG
     UniValue blockHashes(UniValue::VARR);
     while (nHeight < nHeightEnd)
     {
-        std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript, fMineWitnessTx));
+        std::unique_ptr<CBlockTemplate> pblocktemplate(CreateBlockTemplate(Params(), coinbaseScript->reserveScript, fMineWitnessTx));
         if (!pblocktemplate.get())
             throw JSONRPCError(RPC_INTERNAL_ERROR, "Couldn't create new block");
         CBlock *pblock = &pblocktemplate->block;
@@ -570,8 +570,9 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     // Cache whether the last invocation was with segwit support, to avoid returning
     // a segwit-block to a non-segwit caller.
     static bool fLastTemplateSupportsSegwit = true;
+    // A maintained template is cheap to bring up to date, so it follows every mempool change
     if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5) ||
+        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && (g_blockTemplateManager || GetTime() - nStart > 5)) ||
         fLastTemplateSupportsSegwit != fSupportsSegwit)
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
@@ -585,7 +586,7 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
 
         // Create new block
         CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fMineWitnessTx);
+        pblocktemplate = CreateBlockTemplate(Params(), scriptDummy, fMineWitnessTx);
         if (!pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
@@ -977,20 +978,12 @@ UniValue estimatesmartpriority(const JSONRPCRequest& request)
 
 bool fUseNamecoinApi;
 
-/**
- * The variables below are used to keep track of created and not yet
- * submitted auxpow blocks.  Lock them to be sure even for multiple
- * RPC threads running in parallel.
- */
-
-static CCriticalSection cs_auxblockCache;
-static std::map<uint256, CBlock*> mapNewBlock;
-static std::vector<std::unique_ptr<CBlockTemplate>> vNewBlockTemplate;
-
 void AuxMiningCheck()
 {
     if(!g_connman)
         throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+    if (!g_auxBlockCache)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Error: Merge-mining block cache missing");
 
         // if (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0 && !Params().MineBlocksOnDemand())  // FIXME: Is it good? at L506 there is no `!Params().MineBlocksOnDemand()`
         // throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "LebowskisCoin  is not connected!");
@@ -1014,74 +1007,22 @@ static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
 {
 
     AuxMiningCheck();
-    LOCK(cs_auxblockCache);
-
-    static unsigned nTransactionsUpdatedLast;
-    static const CBlockIndex* pindexPrev = nullptr;
-    static uint64_t nStart;
-    static std::map<CScriptID, CBlock*> curBlocks;
-    static unsigned nExtraNonce = 0;
-
-    // lebowskiscoin: Never mine witness tx
-    const bool fMineWitnessTx = false;
 
-    /* Search for cached blocks with given scriptPubKey and assign it to pBlock
-     * if we find a match. This allows for creating multiple aux templates with
-     * a single lebowskiscoind instance, for example when a pool runs multiple sub-
-     * pools with different payout strategies.
+    /* Blocks are cached per scriptPubKey. This allows for creating multiple
+     * aux templates with a single lebowskiscoind instance, for example when a
+     * pool runs multiple sub-pools with different payout strategies.
      */
-    CBlock* pblock = nullptr;
-    CScriptID scriptID (scriptPubKey);
-    auto iter = curBlocks.find(scriptID);
-    if (iter != curBlocks.end()) pblock = iter->second;
+    std::shared_ptr<const CBlockTemplate> pblocktemplate = g_auxBlockCache->Get(scriptPubKey);
+    if (!pblocktemplate)
+        throw JSONRPCError(RPC_OUT_OF_MEMORY, "out of memory");
+    const CBlock* pblock = &pblocktemplate->block;
 
+    int nHeight;
     {
         LOCK(cs_main);
-
-        // Update block
-        if (pblock == nullptr || pindexPrev != chainActive.Tip()
-            || (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast
-                && GetTime() - nStart > 60))
-        {
-            if (pindexPrev != chainActive.Tip())
-            {
-                // Clear old blocks since they're obsolete now.
-                mapNewBlock.clear();
-                vNewBlockTemplate.clear();
-                curBlocks.clear();
-                pblock = nullptr;
-            }
-
-            // Create new block with nonce = 0 and extraNonce = 1
-            std::unique_ptr<CBlockTemplate> newBlock
-                = BlockAssembler(Params()).CreateNewBlock(scriptPubKey, fMineWitnessTx);
-            if (!newBlock)
-                throw JSONRPCError(RPC_OUT_OF_MEMORY, "out of memory");
-
-            // Update state only when CreateNewBlock succeeded
-            nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-            pindexPrev = chainActive.Tip();
-            nStart = GetTime();
-
-            // Finalise it by setting the version and building the merkle root
-            IncrementExtraNonce(&newBlock->block, pindexPrev, nExtraNonce);
-            newBlock->block.SetAuxpowFlag(true);
-
-            // Save
-            pblock = &newBlock->block;
-            curBlocks[scriptID] = pblock;
-            mapNewBlock[pblock->GetHash()] = pblock;
-            vNewBlockTemplate.push_back(std::move(newBlock));
-        }
+        nHeight = mapBlockIndex.at(pblock->hashPrevBlock)->nHeight + 1;
     }
 
-    // At this point, pblock is always initialised:  If we make it here
-    // without creating a new block above, it means that, in particular,
-    // pindexPrev == chainActive.Tip().  But for that to happen, we must
-    // already have created a pblock in a previous call, as pindexPrev is
-    // initialised only when pblock is.
-    assert(pblock);
-
     arith_uint256 target;
     bool fNegative, fOverflow;
     target.SetCompact(pblock->nBits, &fNegative, &fOverflow);
@@ -1094,39 +1035,38 @@ static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
     result.pushKV("previousblockhash", pblock->hashPrevBlock.GetHex());
     result.pushKV("coinbasevalue", (int64_t)pblock->vtx[0]->vout[0].nValue);
     result.pushKV("bits", strprintf("%08x", pblock->nBits));
-    result.pushKV("height", static_cast<int64_t> (pindexPrev->nHeight + 1));
+    result.pushKV("height", static_cast<int64_t> (nHeight));
     result.pushKV(fUseNamecoinApi ? "_target" : "target", HexStr(BEGIN(target), END(target)));
 
     return result;
 }
 
-static bool AuxMiningSubmitBlock(const std::string& hashHex, const std::string& auxpowHex)
+static bool AuxMiningSubmitBlock(const std::string& hashHex, const std::string& auxpowHex, CValidationState& state)
 {
 
     AuxMiningCheck();
-    LOCK(cs_auxblockCache);
 
     uint256 hash;
     hash.SetHex(hashHex);
 
-    const std::map<uint256, CBlock*>::iterator mit = mapNewBlock.find(hash);
-    if (mit == mapNewBlock.end())
+    std::shared_ptr<const CBlockTemplate> pblocktemplate = g_auxBlockCache->Find(hash);
+    if (!pblocktemplate)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "block hash unknown");
-    CBlock& block = *mit->second;
+    // The cached block stays as handed out, for other solutions to the same work
+    std::shared_ptr<CBlock> shared_block = std::make_shared<CBlock>(pblocktemplate->block);
 
     const std::vector<unsigned char> vchAuxPow = ParseHex(auxpowHex);
     CDataStream ss(vchAuxPow, SER_GETHASH, PROTOCOL_VERSION);
     CAuxPow pow;
     ss >> pow;
-    block.SetAuxpow(new CAuxPow(pow));
-    assert(block.GetHash() == hash);
+    shared_block->SetAuxpow(new CAuxPow(pow));
+    assert(shared_block->GetHash() == hash);
 
-    submitblock_StateCatcher sc(block.GetHash());
+    submitblock_StateCatcher sc(shared_block->GetHash());
     RegisterValidationInterface(&sc);
-    std::shared_ptr<const CBlock> shared_block
-      = std::make_shared<const CBlock>(block);
     bool fAccepted = ProcessNewBlock(Params(), shared_block, true, nullptr);
     UnregisterValidationInterface(&sc);
+    state = sc.state;
 
     return fAccepted;
 }
@@ -1177,115 +1117,36 @@ UniValue getauxblockbip22(const JSONRPCRequest& request)
     if (!coinbaseScript->reserveScript.size())
         throw JSONRPCError(RPC_INTERNAL_ERROR, "No coinbase script available (mining requires a wallet)");
 
-    AuxMiningCheck();
-    LOCK(cs_auxblockCache);
-
     /* Create a new block?  */
     if (request.params.size() == 0)
-    {
-        static unsigned nTransactionsUpdatedLast;
-        static const CBlockIndex* pindexPrev = nullptr;
-        static uint64_t nStart;
-        static CBlock* pblock = nullptr;
-        static unsigned nExtraNonce = 0;
-
-        // Update block
-        // lebowskiscoin: Never mine witness tx
-        const bool fMineWitnessTx = false;
-        {
-            LOCK(cs_main);
-            if (pindexPrev != chainActive.Tip()
-                || (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast
-                    && GetTime() - nStart > 60))
-            {
-                if (pindexPrev != chainActive.Tip())
-                {
-                    // Clear old blocks since they're obsolete now.
-                    mapNewBlock.clear();
-                    vNewBlockTemplate.clear();
-                    pblock = nullptr;
-                }
-
-                // Create new block with nonce = 0 and extraNonce = 1
-                std::unique_ptr<CBlockTemplate> newBlock(BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript, fMineWitnessTx));
-                if (!newBlock)
-                    throw JSONRPCError(RPC_OUT_OF_MEMORY, "out of memory");
-
-                // Update state only when CreateNewBlock succeeded
-                nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-                pindexPrev = chainActive.Tip();
-                nStart = GetTime();
-
-                // Finalise it by setting the version and building the merkle root
-                IncrementExtraNonce(&newBlock->block, pindexPrev, nExtraNonce);
-                newBlock->block.SetAuxpowFlag(true);
-
-                // Save
-                pblock = &newBlock->block;
-                mapNewBlock[pblock->GetHash()] = pblock;
-                vNewBlockTemplate.push_back(std::move(newBlock));
-            }
-        }
-
-        arith_uint256 target;
-        bool fNegative, fOverflow;
-        target.SetCompact(pblock->nBits, &fNegative, &fOverflow);
-        if (fNegative || fOverflow || target == 0)
-            throw std::runtime_error("invalid difficulty bits in block");
-
-        UniValue result(UniValue::VOBJ);
-        result.pushKV("hash", pblock->GetHash().GetHex());
-        result.pushKV("chainid", pblock->GetChainId());
-        result.pushKV("previousblockhash", pblock->hashPrevBlock.GetHex());
-        result.pushKV("coinbasevalue", (int64_t)pblock->vtx[0]->vout[0].nValue);
-        result.pushKV("bits", strprintf("%08x", pblock->nBits));
-        result.pushKV("height", static_cast<int64_t> (pindexPrev->nHeight + 1));
-        result.pushKV(fUseNamecoinApi ? "_target" : "target", HexStr(BEGIN(target), END(target)));
-
-        return result;
-    }
+        return AuxMiningCreateBlock(coinbaseScript->reserveScript);
 
     /* Submit a block instead.  Note that this need not lock cs_main,
        since ProcessNewBlock below locks it instead.  */
 
     assert(request.params.size() == 2);
-    uint256 hash;
-    hash.SetHex(request.params[0].get_str());
-
-    const std::map<uint256, CBlock*>::iterator mit = mapNewBlock.find(hash);
-    if (mit == mapNewBlock.end())
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "block hash unknown");
-    CBlock& block = *mit->second;
-
-    const std::vector<unsigned char> vchAuxPow
-      = ParseHex(request.params[1].get_str());
-    CDataStream ss(vchAuxPow, SER_GETHASH, PROTOCOL_VERSION);
-    CAuxPow pow;
-    ss >> pow;
-    block.SetAuxpow(new CAuxPow(pow));
-    assert(block.GetHash() == hash);
-
-    submitblock_StateCatcher sc(block.GetHash());
-    RegisterValidationInterface(&sc);
-    std::shared_ptr<const CBlock> shared_block
-      = std::make_shared<const CBlock>(block);
-    bool fAccepted = ProcessNewBlock(Params(), shared_block, true, nullptr);
-    UnregisterValidationInterface(&sc);
+    CValidationState state;
+    bool fAccepted = AuxMiningSubmitBlock(request.params[0].get_str(),
+                                          request.params[1].get_str(), state);
 
     if (fAccepted)
         coinbaseScript->KeepScript();
 
-    return BIP22ValidationResult(sc.state);
+    return BIP22ValidationResult(state);
 }
 
+
 UniValue createauxblock(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 1)
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
         throw std::runtime_error(
-            "createauxblock <address>\n"
+            "createauxblock <address> ( \"longpollid\" )\n"
             "\ncreate a new block and return information required to merge-mine it.\n"
+            "With a longpollid, wait until the block for address differs from it\n"
+            "(a new tip, or more transactions) before returning.\n"
             "\nArguments:\n"
             "1. address      (string, required) specify coinbase transaction payout address\n"
+            "2. longpollid   (string, optional) hash of the block returned by a previous call\n"
             "\nResult:\n"
             "{\n"
             "  \"hash\"               (string) hash of the created block\n"
@@ -1302,6 +1163,7 @@ UniValue createauxblock(const JSONRPCRequest& request)
             + "}\n"
             "\nExamples:\n"
             + HelpExampleCli("createauxblock", "\"address\"")
+            + HelpExampleCli("createauxblock", "\"address\" \"hash\"")
             + HelpExampleRpc("createauxblock", "\"address\"")
             );
 
@@ -1312,6 +1174,18 @@ UniValue createauxblock(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_PARAMETER,"Invalid coinbase payout address");
 
     const CScript scriptPubKey = GetScriptForDestination(coinbaseAddress.Get());
+
+    if (request.params.size() > 1)
+    {
+        AuxMiningCheck();
+        const uint256 hashWatched = ParseHashV(request.params[1], "longpollid");
+        while (!g_auxBlockCache->WaitForNewBlock(scriptPubKey, hashWatched, boost::get_system_time() + boost::posix_time::seconds(10)))
+        {
+            if (!IsRPCRunning())
+                throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
+        }
+    }
+
     return AuxMiningCreateBlock(scriptPubKey);
 }
 
@@ -1331,8 +1205,9 @@ UniValue submitauxblock(const JSONRPCRequest& request)
             + HelpExampleRpc("submitauxblock", "\"hash\" \"serialised auxpow\"")
             );
 
+    CValidationState state;
     return AuxMiningSubmitBlock(request.params[0].get_str(),
-                                request.params[1].get_str());
+                                request.params[1].get_str(), state);
 }
 
 UniValue getauxblock(const JSONRPCRequest& request)
@@ -1359,7 +1234,7 @@ static const CRPCCommand commands[] =
     { "mining",             "submitblock",            &submitblock,            true,  {"hexdata","parameters"} },
 
     { "mining",             "getauxblock",            &getauxblock,            true,  {"hash", "auxpow"} },
-    { "mining",             "createauxblock",         &createauxblock,         true,  {"address"} },
+    { "mining",             "createauxblock",         &createauxblock,         true,  {"address", "longpollid"} },
     { "mining",             "submitauxblock",         &submitauxblock,         true,  {"hash", "auxpow"} },
 
     { "generating",         "generate",               &generate,               true,  {"nblocks","maxtries","auxpow"} },
@@ -146,6 +146,14 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "    \"bytesrecv_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
+            "    },\n"
+            "    \"recvqueue_per_msg\": {\n"
+            "       \"addr\": {             (json object) Time received messages waited to be processed, by message type\n"
+            "          \"count\": n,         (numeric) The number of messages processed\n"
+            "          \"avg\": n,           (numeric) The average wait in microseconds\n"
+            "          \"max\": n            (numeric) The longest wait in microseconds\n"
+            "       },\n"
+            "       ...\n"
             "    }\n"
             "  }\n"
             "  ,...\n"
@@ -222,6 +230,18 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
         }
         obj.pushKV("bytesrecv_per_msg", recvPerMsgCmd);
 
+        UniValue recvQueuePerMsgCmd(UniValue::VOBJ);
+        BOOST_FOREACH(const mapMsgCmdQueueTime::value_type &i, stats.mapRecvQueueTimePerMsgCmd) {
+            if (i.second.nCount > 0) {
+                UniValue queueTime(UniValue::VOBJ);
+                queueTime.pushKV("count", i.second.nCount);
+                queueTime.pushKV("avg", i.second.nTotalMicros / (int64_t)i.second.nCount);
+                queueTime.pushKV("max", i.second.nMaxMicros);
+                recvQueuePerMsgCmd.pushKV(i.first, queueTime);
+            }
+        }
+        obj.pushKV("recvqueue_per_msg", recvQueuePerMsgCmd);
+
         ret.push_back(obj);
     }
 
@@ -380,6 +400,7 @@ UniValue getnettotals(const JSONRPCRequest& request)
             "  \"totalbytesrecv\": n,   (numeric) Total bytes received\n"
             "  \"totalbytessent\": n,   (numeric) Total bytes sent\n"
             "  \"timemillis\": t,       (numeric) Current UNIX time in milliseconds\n"
+            "  \"socketwakeups\": n,    (numeric) Number of times the socket handler returned from waiting for socket events\n"
             "  \"uploadtarget\":\n"
             "  {\n"
             "    \"timeframe\": n,                         (numeric) Length of the measuring timeframe in seconds\n"
@@ -401,6 +422,7 @@ UniValue getnettotals(const JSONRPCRequest& request)
     obj.pushKV("totalbytesrecv", g_connman->GetTotalBytesRecv());
     obj.pushKV("totalbytessent", g_connman->GetTotalBytesSent());
     obj.pushKV("timemillis", GetTimeMillis());
+    obj.pushKV("socketwakeups", g_connman->GetSocketWakeups());
 
     UniValue outboundLimit(UniValue::VOBJ);
     outboundLimit.pushKV("timeframe", g_connman->GetMaxOutboundTimeframe());
@@ -450,6 +472,7 @@ UniValue getnetworkinfo(const JSONRPCRequest& request)
             "  \"timeoffset\": xxxxx,                   (numeric) the time offset\n"
             "  \"connections\": xxxxx,                  (numeric) the number of connections\n"
             "  \"networkactive\": true|false,           (bool) whether p2p networking is enabled\n"
+            "  \"socketevents\": \"xxx\",                (string) how sockets are waited on (select, poll or epoll)\n"
             "  \"networks\": [                          (array) information per network\n"
             "  {\n"
             "    \"name\": \"xxx\",                     (string) network (ipv4, ipv6 or onion)\n"
@@ -491,6 +514,7 @@ UniValue getnetworkinfo(const JSONRPCRequest& request)
     if (g_connman) {
         obj.pushKV("networkactive", g_connman->GetNetworkActive());
         obj.pushKV("connections",   (int)g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL));
+        obj.pushKV("socketevents",  GetSocketEventsModeName(g_connman->GetSocketEventsMode()));
     }
     obj.pushKV("networks",      GetNetworksInfo());
     obj.pushKV("relayfee",      ValueFromAmount(::minRelayTxFeeRate.GetFeePerK()));
@@ -138,6 +138,57 @@ private:
     size_t nPos;
 };
 
+/** Minimal stream for reading from a byte range owned by someone else,
+ * such as a memory-mapped file, without copying it first.
+ *
+ * The range must outlive the reader.
+ */
+class CSpanReader
+{
+public:
+/*
+ * @param[in]  nTypeIn Serialization Type
+ * @param[in]  nVersionIn Serialization Version (including any flags)
+ * @param[in]  pchDataIn  Start of the range to read
+ * @param[in]  nSizeIn    Number of bytes in the range
+*/
+    CSpanReader(int nTypeIn, int nVersionIn, const unsigned char* pchDataIn, size_t nSizeIn) : nType(nTypeIn), nVersion(nVersionIn), pchData(pchDataIn), nSize(nSizeIn), nPos(0) {}
+
+    void read(char* pch, size_t nRead)
+    {
+        if (nRead > nSize - nPos)
+            throw std::ios_base::failure("CSpanReader::read(): end of data");
+        memcpy(pch, pchData + nPos, nRead);
+        nPos += nRead;
+    }
+    template<typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+    int GetVersion() const
+    {
+        return nVersion;
+    }
+    int GetType() const
+    {
+        return nType;
+    }
+    //! Bytes not read yet
+    size_t size() const
+    {
+        return nSize - nPos;
+    }
+private:
+    const int nType;
+    const int nVersion;
+    const unsigned char* pchData;
+    const size_t nSize;
+    size_t nPos;
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -0,0 +1,187 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Memory for objects of a single size, carved out of chunks that grow
+ * geometrically up to MAX_CHUNK_SIZE. Freed objects go on a free list for
+ * reuse, and all chunks are released at once when the last object is freed.
+ * This avoids a malloc header per object and makes tearing down a large
+ * container cheap.
+ *
+ * The object size is fixed by the first allocation; Allocate returns NULL
+ * for other sizes. Not thread-safe.
+ */
+class PoolResource
+{
+private:
+    struct FreeObject {
+        FreeObject* next;
+    };
+
+    size_t nObjectSize;
+    size_t nNextChunkObjects;
+    std::vector<char*> vChunks;
+    std::vector<size_t> vChunkSizes;
+    char* pUnused;
+    char* pUnusedEnd;
+    FreeObject* pFree;
+    size_t nAllocated;
+    size_t nChunkBytes;
+
+    void Release()
+    {
+        for (char* pChunk : vChunks)
+            ::operator delete(pChunk);
+        vChunks.clear();
+        vChunkSizes.clear();
+        pUnused = pUnusedEnd = NULL;
+        pFree = NULL;
+        nChunkBytes = 0;
+        nNextChunkObjects = MIN_CHUNK_OBJECTS;
+    }
+
+public:
+    static const size_t MIN_CHUNK_OBJECTS = 16;
+    static const size_t MAX_CHUNK_SIZE = 256 * 1024;
+
+    PoolResource() : nObjectSize(0), nNextChunkObjects(MIN_CHUNK_OBJECTS), pUnused(NULL), pUnusedEnd(NULL), pFree(NULL), nAllocated(0), nChunkBytes(0) {}
+    ~PoolResource() { Release(); }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    //! Size an object of nSize bytes and nAlign alignment takes in the pool
+    static size_t ObjectSize(size_t nSize, size_t nAlign)
+    {
+        nAlign = std::max(nAlign, alignof(FreeObject));
+        nSize = std::max(nSize, sizeof(FreeObject));
+        return (nSize + nAlign - 1) / nAlign * nAlign;
+    }
+
+    //! Whether objects of nSize bytes and nAlign alignment come from this pool
+    bool Serves(size_t nSize, size_t nAlign) const
+    {
+        return nObjectSize == ObjectSize(nSize, nAlign);
+    }
+
+    void* Allocate(size_t nSize, size_t nAlign)
+    {
+        if (nObjectSize == 0)
+            nObjectSize = ObjectSize(nSize, nAlign);
+        else if (!Serves(nSize, nAlign))
+            return NULL;
+        nAllocated++;
+        if (pFree) {
+            void* p = pFree;
+            pFree = pFree->next;
+            return p;
+        }
+        if (pUnused == pUnusedEnd) {
+            size_t nBytes = nNextChunkObjects * nObjectSize;
+            char* pChunk = static_cast<char*>(::operator new(nBytes));
+            vChunks.push_back(pChunk);
+            vChunkSizes.push_back(nBytes);
+            nChunkBytes += nBytes;
+            pUnused = pChunk;
+            pUnusedEnd = pChunk + nBytes;
+            nNextChunkObjects = std::max(std::min(nNextChunkObjects * 2, MAX_CHUNK_SIZE / nObjectSize), (size_t)1);
+        }
+        void* p = pUnused;
+        pUnused += nObjectSize;
+        return p;
+    }
+
+    void Deallocate(void* p)
+    {
+        if (--nAllocated == 0) {
+            Release();
+            return;
+        }
+        FreeObject* pObject = static_cast<FreeObject*>(p);
+        pObject->next = pFree;
+        pFree = pObject;
+    }
+
+    //! Number of objects handed out and not freed
+    size_t Allocated() const { return nAllocated; }
+    //! Bytes of all chunks currently allocated, used or not
+    size_t ChunkBytes() const { return nChunkBytes; }
+    //! Sizes of the chunks currently allocated
+    const std::vector<size_t>& ChunkSizes() const { return vChunkSizes; }
+};
+
+/**
+ * Allocator serving single objects of at least MIN_POOLED_SIZE bytes (the
+ * nodes of a node-based container) from a PoolResource, and everything else
+ * (such as bucket arrays) from the heap.
+ *
+ * Each default-constructed allocator, and each copy made when a container
+ * is copied, gets a resource of its own. Rebound copies inside a container
+ * share it, and it moves with the container's nodes on swap and move
+ * assignment, so one resource never serves more than one container.
+ */
+template <typename T, size_t MIN_POOLED_SIZE = sizeof(T)>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    typedef std::false_type propagate_on_container_copy_assignment;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MIN_POOLED_SIZE> other;
+    };
+
+    std::shared_ptr<PoolResource> resource;
+
+    PoolAllocator() : resource(std::make_shared<PoolResource>()) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MIN_POOLED_SIZE>& other) : resource(other.resource) {}
+
+    PoolAllocator select_on_container_copy_construction() const { return PoolAllocator(); }
+
+    T* allocate(size_t n)
+    {
+        if (n == 1 && sizeof(T) >= MIN_POOLED_SIZE) {
+            void* p = resource->Allocate(sizeof(T), alignof(T));
+            if (p)
+                return static_cast<T*>(p);
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (n == 1 && sizeof(T) >= MIN_POOLED_SIZE && resource->Serves(sizeof(T), alignof(T)))
+            resource->Deallocate(p);
+        else
+            ::operator delete(p);
+    }
+};
+
+template <typename T, typename U, size_t N>
+bool operator==(const PoolAllocator<T, N>& a, const PoolAllocator<U, N>& b)
+{
+    return a.resource == b.resource;
+}
+
+template <typename T, typename U, size_t N>
+bool operator!=(const PoolAllocator<T, N>& a, const PoolAllocator<U, N>& b)
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
@@ -4,10 +4,12 @@
 
 #include "util.h"
 
+#include "support/allocators/pool.h"
 #include "support/allocators/secure.h"
 #include "test/test_bitcoin.h"
 
 #include <boost/test/unit_test.hpp>
+#include <boost/unordered_map.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(allocator_tests, BasicTestingSetup)
 
@@ -231,4 +233,63 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(pool_resource_tests)
+{
+    PoolResource pool;
+    BOOST_CHECK_EQUAL(PoolResource::ObjectSize(20, 8), 24);
+    BOOST_CHECK_EQUAL(PoolResource::ObjectSize(1, 1), sizeof(void*));
+
+    // The first allocation fixes the object size
+    std::vector<void*> v;
+    for (size_t i = 0; i < PoolResource::MIN_CHUNK_OBJECTS + 1; i++) {
+        v.push_back(pool.Allocate(24, 8));
+        BOOST_CHECK(v.back() != NULL);
+        BOOST_CHECK_EQUAL((uintptr_t)v.back() % 8, 0);
+    }
+    BOOST_CHECK(pool.Allocate(48, 8) == NULL);
+    BOOST_CHECK(pool.Serves(24, 8) && !pool.Serves(48, 8));
+    BOOST_CHECK_EQUAL(pool.Allocated(), PoolResource::MIN_CHUNK_OBJECTS + 1);
+    // Chunks grow geometrically
+    BOOST_CHECK_EQUAL(pool.ChunkSizes().size(), 2);
+    BOOST_CHECK_EQUAL(pool.ChunkSizes()[1], 2 * pool.ChunkSizes()[0]);
+    BOOST_CHECK_EQUAL(pool.ChunkBytes(), 3 * PoolResource::MIN_CHUNK_OBJECTS * 24);
+
+    // Freed objects are reused, and everything is released with the last one
+    void* p = v.back();
+    v.pop_back();
+    pool.Deallocate(p);
+    BOOST_CHECK(pool.Allocate(24, 8) == p);
+    v.push_back(p);
+    for (void* q : v)
+        pool.Deallocate(q);
+    BOOST_CHECK_EQUAL(pool.Allocated(), 0);
+    BOOST_CHECK_EQUAL(pool.ChunkBytes(), 0);
+    BOOST_CHECK(pool.ChunkSizes().empty());
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocator_tests)
+{
+    typedef boost::unordered_map<int, int64_t, boost::hash<int>, std::equal_to<int>, PoolAllocator<std::pair<const int, int64_t> > > Map;
+    Map map1, map2;
+    for (int i = 0; i < 1000; i++)
+        map1[i] = i;
+    // Nodes come from the pool, bucket arrays do not
+    BOOST_CHECK_EQUAL(map1.get_allocator().resource->Allocated(), 1000);
+    BOOST_CHECK(map2.get_allocator().resource != map1.get_allocator().resource);
+
+    // Copies get a pool of their own, swaps take theirs along
+    Map map3(map1);
+    BOOST_CHECK(map3.get_allocator().resource != map1.get_allocator().resource);
+    BOOST_CHECK_EQUAL(map3.get_allocator().resource->Allocated(), 1000);
+    std::shared_ptr<PoolResource> resource1 = map1.get_allocator().resource;
+    map1.swap(map2);
+    BOOST_CHECK(map2.get_allocator().resource == resource1);
+    BOOST_CHECK_EQUAL(map2.size(), 1000);
+    BOOST_CHECK_EQUAL(map2[999], 999);
+
+    map2.clear();
+    BOOST_CHECK_EQUAL(resource1->Allocated(), 0);
+    BOOST_CHECK_EQUAL(resource1->ChunkBytes(), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
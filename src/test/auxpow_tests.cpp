@@ -3,12 +3,16 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "auxpow.h"
+#include "auxpowcache.h"
 #include "chainparams.h"
+#include "clientversion.h"
 #include "coins.h"
 #include "consensus/merkle.h"
 #include "lebowskiscoin.h"
+#include "powcache.h"
 #include "primitives/block.h"
 #include "script/script.h"
+#include "streams.h"
 #include "uint256.h"
 #include "utilstrencodings.h"
 #include "validation.h"
@@ -443,4 +447,86 @@ BOOST_AUTO_TEST_CASE(auxpow_pow)
 
 /* ************************************************************************** */
 
+BOOST_AUTO_TEST_CASE(auxpow_header_cache)
+{
+    CAuxpowBuilder builder(5, 42);
+    const uint256 hashAux = ArithToUint256(arith_uint256(12345));
+    const std::vector<unsigned char> auxRoot = builder.buildAuxpowChain(hashAux, 3, 0);
+    builder.setCoinbase(CScript() << CAuxpowBuilder::buildCoinbaseData(true, auxRoot, 3, 7));
+    const CAuxPow auxpow = builder.get();
+
+    CAuxPowCache cache;
+    const uint256 hashA = ArithToUint256(arith_uint256(1));
+    const uint256 hashB = ArithToUint256(arith_uint256(2));
+    BOOST_CHECK(!cache.Lookup(hashA));
+    cache.Insert(hashA, auxpow);
+    BOOST_CHECK_EQUAL(cache.Size(), 1);
+
+    /* A cached entry round-trips to the same serialization.  */
+    boost::shared_ptr<CAuxPow> cached = cache.Lookup(hashA);
+    BOOST_CHECK(cached);
+    CDataStream ssOrig(SER_DISK, CLIENT_VERSION), ssCached(SER_DISK, CLIENT_VERSION);
+    ssOrig << auxpow;
+    ssCached << *cached;
+    BOOST_CHECK(ssOrig.str() == ssCached.str());
+    BOOST_CHECK_EQUAL(cache.Hits(), 1);
+    BOOST_CHECK_EQUAL(cache.Misses(), 1);
+
+    /* Shrinking the budget to a single entry evicts the least recently used.  */
+    cache.Insert(hashB, auxpow);
+    BOOST_CHECK(cache.Lookup(hashA));
+    cache.SetMaxUsage(cache.DynamicMemoryUsage() / 2);
+    BOOST_CHECK_EQUAL(cache.Size(), 1);
+    BOOST_CHECK(cache.Contains(hashA));
+    BOOST_CHECK(!cache.Contains(hashB));
+
+    /* A zero budget disables the cache.  */
+    cache.SetMaxUsage(0);
+    BOOST_CHECK_EQUAL(cache.Size(), 0);
+    cache.Insert(hashA, auxpow);
+    BOOST_CHECK(!cache.Lookup(hashA));
+}
+
+/* ************************************************************************** */
+
+BOOST_AUTO_TEST_CASE(auxpow_pow_cache)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const arith_uint256 target = (~arith_uint256(0) >> 1);
+    Consensus::Params params = Params().GetConsensus(0);
+    params.powLimit = ArithToUint256(target);
+
+    CBlockHeader block;
+    block.nVersion = 1;
+    block.nBits = target.GetCompact();
+    const uint256 hashBad = ArithToUint256(~arith_uint256(0));
+
+    /* mineBlock checks against the regtest powLimit, which is too hard.  */
+    auto mine = [&block, &target](bool ok) {
+        block.nNonce = 0;
+        while ((UintToArith256(block.GetPoWHash()) <= target) != ok)
+            ++block.nNonce;
+    };
+
+    /* Valid headers are cached, after which their PoW hash is not needed.  */
+    mine(true);
+    BOOST_CHECK(CheckAuxPowProofOfWorkCached(block, params));
+    BOOST_CHECK(CheckAuxPowProofOfWorkCached(block, params, &hashBad));
+
+    /* Invalid ones are not.  */
+    mine(false);
+    BOOST_CHECK(!CheckAuxPowProofOfWorkCached(block, params));
+    BOOST_CHECK(!CheckAuxPowProofOfWorkCached(block, params));
+
+    /* Entries depend on the consensus parameters.  */
+    mine(true);
+    BOOST_CHECK(CheckAuxPowProofOfWorkCached(block, params));
+    Consensus::Params paramsOther = params;
+    paramsOther.nAuxpowChainId++;
+    BOOST_CHECK(!CheckAuxPowProofOfWorkCached(block, paramsOther, &hashBad));
+    BOOST_CHECK(CheckAuxPowProofOfWorkCached(block, paramsOther));
+}
+
+/* ************************************************************************** */
+
 BOOST_AUTO_TEST_SUITE_END()
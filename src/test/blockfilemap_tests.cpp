@@ -0,0 +1,105 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, BasicTestingSetup)
+
+static std::string WriteTestFile(const boost::filesystem::path& dir, int n, const std::string& strContents)
+{
+    boost::filesystem::path path = dir / strprintf("blk%05u.dat", n);
+    boost::filesystem::ofstream file(path, std::ios::binary);
+    file << strContents;
+    return path.string();
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_lru)
+{
+    boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(dir);
+    std::string strPath0 = WriteTestFile(dir, 0, "block file 0");
+    std::string strPath1 = WriteTestFile(dir, 1, "block file 1");
+    std::string strPath2 = WriteTestFile(dir, 2, "block file 2");
+
+    CBlockFileMapCache cache(2);
+    std::shared_ptr<const CMappedFile> mapped0 = cache.Get(0, strPath0);
+#ifndef WIN32
+    BOOST_REQUIRE(mapped0);
+    BOOST_CHECK_EQUAL(std::string((const char*)mapped0->data(), mapped0->size()), "block file 0");
+    BOOST_CHECK(cache.Get(0, strPath0) == mapped0);
+
+    // File 1 is the least recently used once file 0 is used again
+    BOOST_CHECK(cache.Get(1, strPath1));
+    BOOST_CHECK(cache.Get(0, strPath0) == mapped0);
+    BOOST_CHECK(cache.Get(2, strPath2));
+    BOOST_CHECK_EQUAL(cache.Size(), 2U);
+    BOOST_CHECK(cache.Get(0, strPath0) == mapped0);
+
+    // Evicted and erased mappings stay usable by their holders
+    cache.Erase(0);
+    BOOST_CHECK_EQUAL(cache.Size(), 1U);
+    BOOST_CHECK_EQUAL(std::string((const char*)mapped0->data(), mapped0->size()), "block file 0");
+    BOOST_CHECK(cache.Get(0, strPath0) != mapped0);
+
+    // Missing files and a cache of no mappings map nothing
+    BOOST_CHECK(!cache.Get(3, (dir / "blk00003.dat").string()));
+    cache.SetMaxMaps(0);
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+    BOOST_CHECK(!cache.Get(0, strPath0));
+#endif
+
+    boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(span_reader)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << (uint32_t)0x01020304 << std::string("span");
+    std::vector<unsigned char> vch(ss.begin(), ss.end());
+
+    CSpanReader reader(SER_DISK, CLIENT_VERSION, vch.data(), vch.size());
+    uint32_t n;
+    std::string str;
+    reader >> n >> str;
+    BOOST_CHECK_EQUAL(n, 0x01020304U);
+    BOOST_CHECK_EQUAL(str, "span");
+    BOOST_CHECK_EQUAL(reader.size(), 0U);
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+}
+
+BOOST_FIXTURE_TEST_CASE(read_raw_block, TestingSetup)
+{
+    const CBlockIndex* pindex = chainActive.Genesis();
+    std::vector<unsigned char> vchBlock;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(vchBlock, pindex, Params().MessageStart()));
+    BOOST_CHECK(GetRawBlockHash(vchBlock) == pindex->GetBlockHash());
+
+    // The stored bytes are the serialization of the block
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, Params().GetConsensus(0)));
+    std::vector<unsigned char> vchSerialized;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, vchSerialized, 0, block);
+    BOOST_CHECK(vchBlock == vchSerialized);
+    BOOST_CHECK(IsStoredBlockSerialization(pindex, 0));
+
+    // Blocks are only read where they are stored
+    CMessageHeader::MessageStartChars messageStartWrong = {0, 0, 0, 0};
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, pindex->GetBlockPos(), messageStartWrong));
+    BOOST_CHECK(vchBlock.empty());
+    BOOST_CHECK(GetRawBlockHash(vchBlock).IsNull());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
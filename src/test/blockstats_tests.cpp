@@ -0,0 +1,82 @@
+// Copyright (c) 2021 The Dogecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstats.h"
+#include "chain.h"
+#include "clientversion.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "undo.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockstats_tests, BasicTestingSetup)
+
+static CTransactionRef MakeTx(const CAmount nValueOut, const uint256& hashPrev)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev, 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValueOut;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    return MakeTransactionRef(std::move(tx));
+}
+
+BOOST_AUTO_TEST_CASE(blockstats_compute)
+{
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+    block.vtx.push_back(MakeTx(9 * COIN, uint256S("01")));
+    block.vtx.push_back(MakeTx(4 * COIN, uint256S("02")));
+    block.nTime = 1234;
+
+    // Spend 10 and 5 coins, paying fees of 1 coin each
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(2);
+    blockundo.vtxundo[0].vprevout.push_back(Coin(CTxOut(10 * COIN, CScript() << OP_TRUE), 0, false));
+    blockundo.vtxundo[1].vprevout.push_back(Coin(CTxOut(5 * COIN, CScript() << OP_TRUE), 0, false));
+
+    const uint256 hashBlock = block.GetHash();
+    CBlockIndex index(block);
+    index.phashBlock = &hashBlock;
+    index.nHeight = 7;
+
+    CBlockStats stats;
+    ComputeBlockStats(block, &index, blockundo, stats);
+    BOOST_CHECK(stats.hashBlock == hashBlock);
+    BOOST_CHECK_EQUAL(stats.nHeight, 7);
+    BOOST_CHECK_EQUAL(stats.nTime, 1234);
+    BOOST_CHECK_EQUAL(stats.nTxs, 3);
+    BOOST_CHECK_EQUAL(stats.nIns, 2);
+    BOOST_CHECK_EQUAL(stats.nOuts, 3);
+    BOOST_CHECK_EQUAL(stats.nTotalOut, 13 * COIN);
+    BOOST_CHECK_EQUAL(stats.nTotalFee, 2 * COIN);
+    BOOST_CHECK_EQUAL(stats.nMinFee, COIN);
+    BOOST_CHECK_EQUAL(stats.nMaxFee, COIN);
+    BOOST_CHECK_EQUAL(stats.nMedianFee, COIN);
+    BOOST_CHECK_EQUAL(stats.nMinTxSize, stats.nMaxTxSize);
+    BOOST_CHECK_EQUAL(stats.nTotalSize, 2 * stats.nMinTxSize);
+    BOOST_CHECK_EQUAL(stats.nSwTxs, 0);
+
+    // Records are fixed-width and round-trip
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << stats;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * 32 + 4 + 26 * 8);
+    CBlockStats statsRead;
+    ss >> statsRead;
+    BOOST_CHECK(statsRead.hashBlock == stats.hashBlock);
+    BOOST_CHECK_EQUAL(statsRead.nTotalFee, stats.nTotalFee);
+    BOOST_CHECK_EQUAL(statsRead.vFeeRatePercentiles[4], stats.vFeeRatePercentiles[4]);
+    BOOST_CHECK_EQUAL(statsRead.nUtxoSizeInc, stats.nUtxoSizeInc);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
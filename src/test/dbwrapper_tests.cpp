@@ -2,7 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chain.h"
 #include "dbwrapper.h"
+#include "primitives/block.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "random.h"
 #include "test/test_bitcoin.h"
@@ -122,6 +125,98 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_options)
+{
+    CDBOptions opts;
+    std::string strError;
+    BOOST_CHECK(ParseDBOptions("", opts, strError));
+    BOOST_CHECK_EQUAL(opts.ToString(), CDBOptions().ToString());
+
+    BOOST_CHECK(ParseDBOptions("compression=snappy,maxopenfiles=1000,maxfilesize=32,bloombits=0", opts, strError));
+    BOOST_CHECK(opts.fCompression);
+    BOOST_CHECK_EQUAL(opts.nMaxOpenFiles, 1000);
+    BOOST_CHECK_EQUAL(opts.nMaxFileSize, 32);
+    BOOST_CHECK_EQUAL(opts.nBloomBits, 0);
+    BOOST_CHECK_EQUAL(opts.ToString(), "compression=snappy,maxopenfiles=1000,maxfilesize=32,bloombits=0");
+
+    // Failures leave an error and are rejected as a whole by the caller
+    BOOST_CHECK(!ParseDBOptions("compression=zlib", opts, strError));
+    BOOST_CHECK(!ParseDBOptions("maxopenfiles=8", opts, strError));
+    BOOST_CHECK(!ParseDBOptions("maxfilesize=0", opts, strError));
+    BOOST_CHECK(!ParseDBOptions("bloombits=x", opts, strError));
+    BOOST_CHECK(!ParseDBOptions("blocksize=4", opts, strError));
+    BOOST_CHECK(!ParseDBOptions("compression", opts, strError));
+    BOOST_CHECK(!strError.empty());
+
+    // The database opens with the options and reports its properties
+    boost::filesystem::path ph = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    CDBWrapper dbw(ph, (1 << 20), true, false, false, opts);
+    BOOST_CHECK_EQUAL(dbw.GetDBOptions().ToString(), opts.ToString());
+    BOOST_CHECK(dbw.Write('k', GetRandHash()));
+    std::string strValue;
+    BOOST_CHECK(dbw.GetProperty("leveldb.stats", strValue));
+    BOOST_CHECK(dbw.GetProperty("leveldb.num-files-at-level0", strValue));
+    BOOST_CHECK(!dbw.GetProperty("leveldb.unknown", strValue));
+}
+
+BOOST_AUTO_TEST_CASE(blocktree_load_index)
+{
+    // A chain of block index entries, with a fork at every tenth height
+    const int nBlocks = 500;
+    std::vector<uint256> vHashes(nBlocks);
+    std::vector<CBlockIndex> vIndex(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        CBlockHeader header;
+        header.nVersion = 1;
+        header.hashPrevBlock = i == 0 ? uint256() : vHashes[i % 10 == 1 && i > 10 ? i - 2 : i - 1];
+        header.nTime = i;
+        header.nBits = 0x207fffff - i;
+        header.nNonce = i;
+        vHashes[i] = header.GetHash();
+        vIndex[i] = CBlockIndex(header);
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].pprev = i == 0 ? NULL : &vIndex[i % 10 == 1 && i > 10 ? i - 2 : i - 1];
+        vIndex[i].nHeight = vIndex[i].pprev ? vIndex[i].pprev->nHeight + 1 : 0;
+        vIndex[i].nStatus = BLOCK_VALID_TREE | BLOCK_HAVE_DATA;
+        vIndex[i].nFile = i / 100;
+        vIndex[i].nDataPos = i * 1000;
+        vIndex[i].nTx = i + 1;
+    }
+    std::vector<const CBlockIndex*> vpIndex;
+    for (const CBlockIndex& index : vIndex)
+        vpIndex.push_back(&index);
+    CBlockTreeDB blocktree(1 << 20, true, true);
+    BOOST_REQUIRE(blocktree.WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, vpIndex));
+
+    // Whatever the number of threads, every entry is loaded once with the work of its own block
+    for (int nThreads : {1, 3, 16}) {
+        std::map<uint256, CBlockIndex> mapLoaded;
+        int nInserted = 0;
+        BOOST_CHECK(blocktree.LoadBlockIndexGuts([&](const uint256& hash) -> CBlockIndex* {
+            if (hash.IsNull())
+                return NULL;
+            std::map<uint256, CBlockIndex>::iterator it = mapLoaded.find(hash);
+            if (it == mapLoaded.end()) {
+                it = mapLoaded.insert(std::make_pair(hash, CBlockIndex())).first;
+                it->second.phashBlock = &it->first;
+                nInserted++;
+            }
+            return &it->second;
+        }, nThreads));
+        BOOST_CHECK_EQUAL(nInserted, nBlocks);
+        for (int i = 0; i < nBlocks; i++) {
+            const CBlockIndex& loaded = mapLoaded[vHashes[i]];
+            BOOST_CHECK(loaded.pprev == (i == 0 ? NULL : &mapLoaded[vIndex[i].pprev->GetBlockHash()]));
+            BOOST_CHECK_EQUAL(loaded.nHeight, vIndex[i].nHeight);
+            BOOST_CHECK_EQUAL(loaded.nFile, vIndex[i].nFile);
+            BOOST_CHECK_EQUAL(loaded.nDataPos, vIndex[i].nDataPos);
+            BOOST_CHECK_EQUAL(loaded.nTx, vIndex[i].nTx);
+            BOOST_CHECK_EQUAL(loaded.nBits, vIndex[i].nBits);
+            BOOST_CHECK(loaded.nChainWork == GetBlockProof(vIndex[i]));
+        }
+    }
+}
+
 // Test that we do not obfuscation if there is existing data.
 BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate)
 {
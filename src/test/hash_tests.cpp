@@ -128,6 +128,13 @@ BOOST_AUTO_TEST_CASE(siphash)
     tx.nVersion = 1;
     ss << tx;
     BOOST_CHECK_EQUAL(SipHashUint256(1, 2, ss.GetHash()), 0x79751e980c2a0a35ULL);
+
+    // Check SipHashUint256Extra against the generic implementation
+    uint256 hashVal = ss.GetHash();
+    unsigned char extra[4] = {0x04, 0x03, 0x02, 0x01};
+    CSipHasher hasher4(1, 2);
+    hasher4.Write(hashVal.begin(), 32).Write(extra, 4);
+    BOOST_CHECK_EQUAL(SipHashUint256Extra(1, 2, hashVal, 0x01020304), hasher4.Finalize());
 }
 
 BOOST_AUTO_TEST_SUITE_END()
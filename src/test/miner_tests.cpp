@@ -12,6 +12,8 @@
 #include "miner.h"
 #include "policy/policy.h"
 #include "pubkey.h"
+#include "random.h"
+#include "scheduler.h"
 #include "script/standard.h"
 #include "txmempool.h"
 #include "uint256.h"
@@ -497,4 +499,88 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_AUTO_TEST_CASE(template_manager_updates)
+{
+    const CChainParams& chainparams = Params(CBaseChainParams::MAIN);
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    TestMemPoolEntryHelper entry;
+    CBlockTemplateManager manager(chainparams, DEFAULT_BLOCK_TEMPLATE_REBUILD);
+    RegisterValidationInterface(&manager);
+
+    LOCK(cs_main);
+    std::unique_ptr<CBlockTemplate> pblocktemplate = manager.CreateNewBlock(scriptPubKey, true);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1U);
+
+    // Transactions accepted after the template was built are appended to it
+    // (their inputs are made up, as maintained templates are not re-validated)
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout.hash = GetRandHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = COIN;
+    CTransaction txParent(tx);
+    mempool.addUnchecked(txParent.GetHash(), entry.Fee(CENT).FromTx(txParent));
+    tx.vin[0].prevout.hash = txParent.GetHash();
+    CTransaction txChild(tx);
+    mempool.addUnchecked(txChild.GetHash(), entry.Fee(2 * CENT).FromTx(txChild));
+
+    pblocktemplate = manager.CreateNewBlock(scriptPubKey, true);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 3U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == txParent.GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == txChild.GetHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -3 * CENT);
+    BOOST_CHECK(pblocktemplate->block.hashPrevBlock == chainActive.Tip()->GetBlockHash());
+
+    // Transactions below the block min fee, and their descendants, are left out
+    tx.vin[0].prevout.hash = GetRandHash();
+    CTransaction txFree(tx);
+    mempool.addUnchecked(txFree.GetHash(), entry.Fee(0).FromTx(txFree));
+    tx.vin[0].prevout.hash = txFree.GetHash();
+    CTransaction txFreeChild(tx);
+    mempool.addUnchecked(txFreeChild.GetHash(), entry.Fee(CENT).FromTx(txFreeChild));
+    pblocktemplate = manager.CreateNewBlock(scriptPubKey, true);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3U);
+
+    // Removed transactions are dropped along with their fees
+    mempool.removeRecursive(txParent);
+    pblocktemplate = manager.CreateNewBlock(scriptPubKey, true);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1U);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], 0);
+
+    UnregisterValidationInterface(&manager);
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(aux_block_cache_bounds)
+{
+    const CChainParams& chainparams = Params(CBaseChainParams::MAIN);
+    CScheduler scheduler;
+    CAuxBlockCache cache(chainparams, scheduler);
+
+    // Templates are cached per script until the tip or the mempool changes
+    CScript scriptFirst = CScript() << OP_TRUE;
+    std::shared_ptr<const CBlockTemplate> pblocktemplate = cache.Get(scriptFirst);
+    BOOST_REQUIRE(pblocktemplate);
+    BOOST_CHECK(pblocktemplate->block.IsAuxpow());
+    BOOST_CHECK(pblocktemplate->block.hashPrevBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK(cache.Get(scriptFirst) == pblocktemplate);
+    const uint256 hashFirst = pblocktemplate->block.GetHash();
+    BOOST_CHECK(cache.Find(hashFirst) == pblocktemplate);
+    BOOST_CHECK(!cache.Find(uint256()));
+
+    // The least recently used script is evicted along with its templates
+    const uint256 hashSecond = cache.Get(CScript() << OP_FALSE << OP_DROP << OP_TRUE)->block.GetHash();
+    for (size_t i = 2; i < MAX_AUX_BLOCK_SCRIPTS; i++)
+        BOOST_CHECK(cache.Get(CScript() << CScriptNum(i) << OP_DROP << OP_TRUE));
+    BOOST_CHECK_EQUAL(cache.GetScriptCount(), MAX_AUX_BLOCK_SCRIPTS);
+    BOOST_CHECK(cache.Get(scriptFirst) == pblocktemplate);
+    BOOST_CHECK(cache.Get(CScript() << OP_1NEGATE << OP_DROP << OP_TRUE));
+    BOOST_CHECK_EQUAL(cache.GetScriptCount(), MAX_AUX_BLOCK_SCRIPTS);
+    BOOST_CHECK_EQUAL(cache.GetTemplateCount(), MAX_AUX_BLOCK_SCRIPTS);
+    BOOST_CHECK(cache.Find(hashFirst) == pblocktemplate);
+    BOOST_CHECK(!cache.Find(hashSecond));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
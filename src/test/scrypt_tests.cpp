@@ -32,4 +32,41 @@ BOOST_AUTO_TEST_CASE(scrypt_hashtest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(scrypt_multi)
+{
+    // Compare multi-buffer hashing against the generic implementation, for
+    // every kernel the CPU supports and group sizes around the lane counts.
+    const char* inputhex = "020000004c1271c211717198227392b029a64a7971931d351b387bb80db027f270411e398a07046f7d4a08dd815412a8712f874a7ebf0507e3878bd24e20a3b73fd750a667d2f451eac7471b00de6659";
+    const size_t MAX_INPUTS = 37;
+    std::vector<std::vector<unsigned char> > inputs(MAX_INPUTS, ParseHex(inputhex));
+    std::vector<uint256> expected(MAX_INPUTS);
+    char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+    for (size_t i = 0; i < MAX_INPUTS; i++) {
+        // Vary the nonce, leaving the first input as is
+        inputs[i][78] ^= i * 7;
+        inputs[i][79] ^= i;
+        scrypt_1024_1_1_256_sp_generic((const char*)&inputs[i][0], BEGIN(expected[i]), scratchpad);
+    }
+    BOOST_CHECK_EQUAL(expected[0].ToString(), "00000000002bef4107f882f6115e0b01f348d21195dacd3582aa2dabd7985806");
+
+    const size_t lanes[] = {1, 8, 16};
+    const size_t counts[] = {0, 1, 2, 7, 8, 9, 15, 16, 17, 24, 37};
+    for (size_t max_lanes : lanes) {
+        const std::string name = scrypt_detect_multi(max_lanes);
+        for (size_t n : counts) {
+            std::vector<const char*> in(n);
+            std::vector<char*> out(n);
+            std::vector<uint256> hashes(n);
+            for (size_t i = 0; i < n; i++) {
+                in[i] = (const char*)&inputs[i][0];
+                out[i] = BEGIN(hashes[i]);
+            }
+            scrypt_1024_1_1_256_multi(in.data(), out.data(), n);
+            for (size_t i = 0; i < n; i++)
+                BOOST_CHECK_MESSAGE(hashes[i] == expected[i], name << ": input " << i << " of " << n);
+        }
+    }
+    scrypt_detect_multi();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
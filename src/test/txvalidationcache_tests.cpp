@@ -85,4 +85,133 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain240Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_mempool_parallel_script_checks, TestChain240Setup)
+{
+    // Transactions with several inputs have their script checks spread
+    // over the script check threads; the result and the reject reason
+    // must be the same as when checking serially.
+    BOOST_CHECK(nScriptCheckThreads > 0);
+
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(4);
+    for (unsigned int i = 0; i < spend.vin.size(); i++) {
+        spend.vin[i].prevout.hash = coinbaseTxns[i].GetHash();
+        spend.vin[i].prevout.n = 0;
+    }
+    spend.vout.resize(1);
+    spend.vout[0].nValue = COIN;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    for (unsigned int i = 0; i < spend.vin.size(); i++) {
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, spend, i, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        spend.vin[i].scriptSig = CScript() << vchSig;
+    }
+
+    // A bad signature on the last input is rejected with the serial reason
+    CMutableTransaction badSpend(spend);
+    std::vector<unsigned char> vchBadSig(spend.vin[0].scriptSig.begin() + 1, spend.vin[0].scriptSig.end());
+    badSpend.vin[3].scriptSig = CScript() << vchBadSig;
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(!AcceptToMemoryPool(mempool, state, MakeTransactionRef(badSpend), false, NULL, NULL, true, 0));
+        BOOST_CHECK(state.GetRejectReason().find("mandatory-script-verify-flag-failed") == 0);
+        int nDoS;
+        BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 100);
+    }
+    BOOST_CHECK_EQUAL(mempool.size(), 0);
+
+    BOOST_CHECK(ToMemPool(spend));
+    BOOST_CHECK_EQUAL(mempool.size(), 1);
+    mempool.clear();
+}
+
+static CMutableTransaction
+SpendOutput(const CKey& key, const CTransaction& txFrom, unsigned int n, const CAmount nValue)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(txFrom.GetHash(), n);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = nValue;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(txFrom.vout[n].scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    return spend;
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_mempool_batch, TestingSetup)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    // Some confirmed outputs to spend
+    CMutableTransaction funding;
+    funding.nVersion = 1;
+    funding.vin.resize(1);
+    funding.vin[0].prevout = COutPoint(uint256S("01"), 0);
+    funding.vout.resize(4);
+    for (unsigned int i = 0; i < funding.vout.size(); i++) {
+        funding.vout[i].nValue = 100 * COIN;
+        funding.vout[i].scriptPubKey = scriptPubKey;
+    }
+    const CTransaction txFunding(funding);
+    {
+        LOCK(cs_main);
+        AddCoins(*pcoinsTip, txFunding, 1);
+    }
+
+    // A chain of three, given children first
+    const CTransaction txA(SpendOutput(key, txFunding, 0, 99 * COIN));
+    const CTransaction txB(SpendOutput(key, txA, 0, 98 * COIN));
+    const CTransaction txC(SpendOutput(key, txB, 0, 97 * COIN));
+    // An unrelated one
+    const CTransaction txD(SpendOutput(key, txFunding, 1, 99 * COIN));
+    // One with a bad signature
+    CMutableTransaction bad = SpendOutput(key, txFunding, 2, 99 * COIN);
+    bad.vin[0].scriptSig = txD.vin[0].scriptSig;
+    const CTransaction txBad(bad);
+    // An orphan
+    CMutableTransaction orphan = SpendOutput(key, txFunding, 3, 99 * COIN);
+    orphan.vin[0].prevout.hash = uint256S("02");
+    const CTransaction txOrphan(orphan);
+
+    std::vector<CTransactionRef> vtx;
+    vtx.push_back(MakeTransactionRef(txC));
+    vtx.push_back(MakeTransactionRef(txBad));
+    vtx.push_back(MakeTransactionRef(txB));
+    vtx.push_back(MakeTransactionRef(txOrphan));
+    vtx.push_back(MakeTransactionRef(txD));
+    vtx.push_back(MakeTransactionRef(txA));
+
+    std::vector<CValidationState> vState;
+    std::vector<bool> vAccepted;
+    std::vector<bool> vMissingInputs;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(AcceptToMemoryPoolBatch(mempool, vtx, vState, vAccepted, false, &vMissingInputs), 4);
+    }
+    BOOST_CHECK_EQUAL(vAccepted.size(), vtx.size());
+    BOOST_CHECK(vAccepted[0] && vAccepted[2] && vAccepted[4] && vAccepted[5]);
+    BOOST_CHECK(!vAccepted[1] && !vMissingInputs[1]);
+    BOOST_CHECK(vState[1].GetRejectReason().find("mandatory-script-verify-flag-failed") == 0);
+    BOOST_CHECK(!vAccepted[3] && vMissingInputs[3]);
+    BOOST_CHECK_EQUAL(mempool.size(), 4);
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
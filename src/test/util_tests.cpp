@@ -88,6 +88,18 @@ BOOST_AUTO_TEST_CASE(util_HexStr)
     BOOST_CHECK_EQUAL(
         HexStr(ParseHex_vec, true),
         "04 67 8a fd b0");
+
+    // HexEncode matches HexStr, including the bytes after the last full group of eight
+    std::string strHex(2 * sizeof(ParseHex_expected), ' ');
+    HexEncode(&strHex[0], ParseHex_expected, sizeof(ParseHex_expected));
+    BOOST_CHECK_EQUAL(strHex, HexStr(ParseHex_expected, ParseHex_expected + sizeof(ParseHex_expected)));
+
+    std::vector<unsigned char> vchAll;
+    for (int i = 0; i < 256; i++)
+        vchAll.push_back(i);
+    strHex.assign(2 * vchAll.size(), ' ');
+    HexEncode(&strHex[0], vchAll.data(), vchAll.size());
+    BOOST_CHECK_EQUAL(strHex, HexStr(vchAll));
 }
 
 
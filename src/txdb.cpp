@@ -5,19 +5,28 @@
 
 #include "txdb.h"
 
+#include "blockstats.h"
 #include "chainparams.h"
 #include "hash.h"
+#include "init.h"
+#include "memusage.h"
 #include "pow.h"
+#include "ui_interface.h"
 #include "uint256.h"
+#include "util.h"
 
 #include <stdint.h>
+#include <deque>
+#include <functional>
 
 #include <boost/thread.hpp>
 
+static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
+static const char DB_BLOCK_STATS = 's';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
@@ -25,49 +34,328 @@ static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+namespace {
+
+struct CoinEntry {
+    COutPoint* outpoint;
+    char key;
+    CoinEntry(const COutPoint* ptr) : outpoint(const_cast<COutPoint*>(ptr)), key(DB_COIN)  {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << key;
+        s << outpoint->hash;
+        s << VARINT(outpoint->n);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        s >> outpoint->hash;
+        s >> VARINT(outpoint->n);
+    }
+};
+
+/**
+ * Legacy per-transaction UTXO record, as stored in the chainstate database
+ * before it was keyed per output. Only used to read the old records when the
+ * database is upgraded.
+ *
+ * Serialized format:
+ * - VARINT(nVersion)
+ * - VARINT(nCode)
+ * - unspentness bitvector, for vout[2] and further; least significant byte first
+ * - the non-spent CTxOuts (via CTxOutCompressor)
+ * - VARINT(nHeight)
+ *
+ * The nCode value consists of:
+ * - bit 0: IsCoinBase()
+ * - bit 1: vout[0] is not spent
+ * - bit 2: vout[1] is not spent
+ * - The higher bits encode N, the number of non-zero bytes in the following bitvector.
+ *   - In case both bit 1 and bit 2 are unset, they encode N-1, as there must be at
+ *     least one non-spent output).
+ */
+class CCoins
 {
+public:
+    //! whether transaction is a coinbase
+    bool fCoinBase;
+
+    //! unspent transaction outputs; spent outputs are .IsNull()
+    std::vector<CTxOut> vout;
+
+    //! at which height this transaction was included in the active block chain
+    int nHeight;
+
+    //! empty constructor
+    CCoins() : fCoinBase(false), vout(0), nHeight(0) { }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        unsigned int nCode = 0;
+        // version
+        int nVersionDummy;
+        ::Unserialize(s, VARINT(nVersionDummy));
+        // header code
+        ::Unserialize(s, VARINT(nCode));
+        fCoinBase = nCode & 1;
+        std::vector<bool> vAvail(2, false);
+        vAvail[0] = (nCode & 2) != 0;
+        vAvail[1] = (nCode & 4) != 0;
+        unsigned int nMaskCode = (nCode / 8) + ((nCode & 6) != 0 ? 0 : 1);
+        // spentness bitmask
+        while (nMaskCode > 0) {
+            unsigned char chAvail = 0;
+            ::Unserialize(s, chAvail);
+            for (unsigned int p = 0; p < 8; p++) {
+                bool f = (chAvail & (1 << p)) != 0;
+                vAvail.push_back(f);
+            }
+            if (chAvail != 0)
+                nMaskCode--;
+        }
+        // txouts themself
+        vout.assign(vAvail.size(), CTxOut());
+        for (unsigned int i = 0; i < vAvail.size(); i++) {
+            if (vAvail[i])
+                ::Unserialize(s, REF(CTxOutCompressor(vout[i])));
+        }
+        // coinbase height
+        ::Unserialize(s, VARINT(nHeight));
+    }
+};
+
 }
 
-bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(std::make_pair(DB_COINS, txid), coins);
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, bool fBackgroundFlushIn, const CDBOptions& dbopts) :
+    db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, dbopts),
+    fBackgroundFlush(fBackgroundFlushIn), fFlushPending(false), fFlushFailed(false), fFlushStop(false), nFlushingUsage(0)
+{
+    if (fBackgroundFlush)
+        threadFlush = std::thread(&TraceThread<std::function<void()> >, "coinsflush", std::function<void()>(std::bind(&CCoinsViewDB::ThreadFlush, this)));
 }
 
-bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(std::make_pair(DB_COINS, txid));
+CCoinsViewDB::~CCoinsViewDB()
+{
+    if (threadFlush.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(csFlush);
+            fFlushStop = true;
+        }
+        condFlush.notify_all();
+        // A batch still pending is written before the thread exits
+        threadFlush.join();
+    }
+}
+
+bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    if (fBackgroundFlush) {
+        std::lock_guard<std::mutex> lock(csFlush);
+        CCoinsMap::const_iterator it = mapFlushing.find(outpoint);
+        if (it != mapFlushing.end()) {
+            coin = it->second.coin;
+            return !coin.IsSpent();
+        }
+    }
+    return db.Read(CoinEntry(&outpoint), coin);
+}
+
+bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    if (fBackgroundFlush) {
+        std::lock_guard<std::mutex> lock(csFlush);
+        CCoinsMap::const_iterator it = mapFlushing.find(outpoint);
+        if (it != mapFlushing.end())
+            return !it->second.coin.IsSpent();
+    }
+    return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    if (fBackgroundFlush) {
+        std::lock_guard<std::mutex> lock(csFlush);
+        if (fFlushPending && !hashFlushing.IsNull())
+            return hashFlushing;
+    }
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
     return hashBestChain;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(std::make_pair(DB_COINS, it->first));
+            CoinEntry entry(&it->first);
+            if (it->second.coin.IsSpent())
+                batch.Erase(entry);
             else
-                batch.Write(std::make_pair(DB_COINS, it->first), it->second.coins);
+                batch.Write(entry, it->second.coin);
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
     }
     if (!hashBlock.IsNull())
         batch.Write(DB_BEST_BLOCK, hashBlock);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint("coindb", "Committing %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    if (!fBackgroundFlush) {
+        bool fOk = WriteCoins(mapCoins, hashBlock);
+        mapCoins.clear();
+        return fOk;
+    }
+
+    std::unique_lock<std::mutex> lock(csFlush);
+    if (fFlushPending && !fFlushFailed) {
+        int64_t nStart = GetTimeMicros();
+        condFlush.wait(lock, [this]{ return !fFlushPending || fFlushFailed; });
+        LogPrint("coindb", "Waited %.2fms for the previous coin database flush\n", 0.001 * (GetTimeMicros() - nStart));
+    }
+    if (fFlushFailed)
+        return false;
+    mapFlushing.swap(mapCoins);
+    hashFlushing = hashBlock;
+    fFlushPending = true;
+    condFlush.notify_all();
+    return true;
+}
+
+bool CCoinsViewDB::IsFlushing() const {
+    std::lock_guard<std::mutex> lock(csFlush);
+    return fFlushPending;
+}
+
+bool CCoinsViewDB::FlushFailed() const {
+    std::lock_guard<std::mutex> lock(csFlush);
+    return fFlushFailed;
+}
+
+bool CCoinsViewDB::SyncFlush() const {
+    std::unique_lock<std::mutex> lock(csFlush);
+    condFlush.wait(lock, [this]{ return !fFlushPending || fFlushFailed; });
+    return !fFlushFailed;
+}
+
+void CCoinsViewDB::ThreadFlush()
+{
+    std::unique_lock<std::mutex> lock(csFlush);
+    while (true) {
+        condFlush.wait(lock, [this]{ return (fFlushPending && !fFlushFailed) || fFlushStop; });
+        if (!fFlushPending || fFlushFailed)
+            return;
+        lock.unlock();
+
+        // Nothing modifies mapFlushing until it has been written, so it can
+        // be read here without csFlush, concurrently with GetCoin.
+        size_t nUsage = memusage::DynamicUsage(mapFlushing);
+        for (CCoinsMap::const_iterator it = mapFlushing.begin(); it != mapFlushing.end(); it++)
+            nUsage += it->second.coin.DynamicMemoryUsage();
+        nFlushingUsage = nUsage;
+
+        int64_t nStart = GetTimeMicros();
+        bool fOk = false;
+        try {
+            fOk = WriteCoins(mapFlushing, hashFlushing);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        LogPrint("coindb", "Background coin database flush took %.2fms\n", 0.001 * (GetTimeMicros() - nStart));
+
+        CCoinsMap mapWritten;
+        lock.lock();
+        if (fOk) {
+            mapWritten.swap(mapFlushing);
+            hashFlushing.SetNull();
+            fFlushPending = false;
+            nFlushingUsage = 0;
+        } else {
+            // Keep the batch readable, so the view stays consistent until shutdown
+            LogPrintf("*** Failed to write to coin database\n");
+            fFlushFailed = true;
+        }
+        condFlush.notify_all();
+        // Free the written entries without holding csFlush
+        lock.unlock();
+        mapWritten.clear();
+        lock.lock();
+    }
+}
+
+bool CCoinsViewDB::Upgrade() {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(DB_COINS, uint256()));
+    if (!pcursor->Valid()) {
+        return true;
+    }
+
+    int64_t count = 0;
+    LogPrintf("Upgrading utxo-set database...\n");
+    LogPrintf("[0%%]...");
+    uiInterface.ShowProgress(_("Upgrading UTXO database"), 0);
+    size_t batch_size = 1 << 24;
+    CDBBatch batch(db);
+    int reportDone = 0;
+    std::pair<unsigned char, uint256> key;
+    const std::pair<unsigned char, uint256> first_key(DB_COINS, uint256());
+    std::pair<unsigned char, uint256> prev_key = first_key;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) {
+            break;
+        }
+        if (pcursor->GetKey(key) && key.first == DB_COINS) {
+            if (count++ % 256 == 0) {
+                uint32_t high = 0x100 * *key.second.begin() + *(key.second.begin() + 1);
+                int percentageDone = (int)(high * 100.0 / 65536.0 + 0.5);
+                uiInterface.ShowProgress(_("Upgrading UTXO database"), percentageDone);
+                if (reportDone < percentageDone/10) {
+                    // report max. every 10% step
+                    LogPrintf("[%d%%]...", percentageDone);
+                    reportDone = percentageDone/10;
+                }
+            }
+            CCoins old_coins;
+            if (!pcursor->GetValue(old_coins)) {
+                return error("%s: cannot parse CCoins record", __func__);
+            }
+            COutPoint outpoint(key.second, 0);
+            for (size_t i = 0; i < old_coins.vout.size(); ++i) {
+                if (!old_coins.vout[i].IsNull() && !old_coins.vout[i].scriptPubKey.IsUnspendable()) {
+                    Coin newcoin(std::move(old_coins.vout[i]), old_coins.nHeight, old_coins.fCoinBase);
+                    outpoint.n = i;
+                    CoinEntry entry(&outpoint);
+                    batch.Write(entry, newcoin);
+                }
+            }
+            // Converting a record and erasing it happen in the same batch, so
+            // an interrupted upgrade resumes where it stopped
+            batch.Erase(key);
+            if (batch.SizeEstimate() > batch_size) {
+                db.WriteBatch(batch);
+                batch.Clear();
+                db.CompactRange(prev_key, key);
+                prev_key = key;
+            }
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+    db.WriteBatch(batch);
+    db.CompactRange(first_key, key);
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
+    return !ShutdownRequested();
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, const CDBOptions& dbopts) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, dbopts) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -92,33 +380,37 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
+    // The cursor only sees what is on disk
+    SyncFlush();
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COINS);
+    i->pcursor->Seek(DB_COIN);
     // Cache key of first record
     if (i->pcursor->Valid()) {
-        i->pcursor->GetKey(i->keyTmp);
+        CoinEntry entry(&i->keyTmp.second);
+        i->pcursor->GetKey(entry);
+        i->keyTmp.first = entry.key;
     } else {
         i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
     }
     return i;
 }
 
-bool CCoinsViewDBCursor::GetKey(uint256 &key) const
+bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 {
     // Return cached key
-    if (keyTmp.first == DB_COINS) {
+    if (keyTmp.first == DB_COIN) {
         key = keyTmp.second;
         return true;
     }
     return false;
 }
 
-bool CCoinsViewDBCursor::GetValue(CCoins &coins) const
+bool CCoinsViewDBCursor::GetValue(Coin &coin) const
 {
-    return pcursor->GetValue(coins);
+    return pcursor->GetValue(coin);
 }
 
 unsigned int CCoinsViewDBCursor::GetValueSize() const
@@ -128,14 +420,108 @@ unsigned int CCoinsViewDBCursor::GetValueSize() const
 
 bool CCoinsViewDBCursor::Valid() const
 {
-    return keyTmp.first == DB_COINS;
+    return keyTmp.first == DB_COIN;
 }
 
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
-    if (!pcursor->Valid() || !pcursor->GetKey(keyTmp))
+    CoinEntry entry(&keyTmp.second);
+    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
         keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
+    } else {
+        keyTmp.first = entry.key;
+    }
+}
+
+CCoinsViewDBSnapshot::CCoinsViewDBSnapshot(const CCoinsViewDB &view) : db(const_cast<CDBWrapper&>(view.db))
+{
+    view.SyncFlush();
+    psnapshot = db.GetSnapshot();
+
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator(psnapshot));
+    pcursor->Seek(DB_BEST_BLOCK);
+    char chKey;
+    if (!(pcursor->Valid() && pcursor->GetKeySize() == 1 && pcursor->GetKey(chKey) && chKey == DB_BEST_BLOCK && pcursor->GetValue(hashBlock)))
+        hashBlock.SetNull();
+}
+
+CCoinsViewDBSnapshot::~CCoinsViewDBSnapshot()
+{
+    db.ReleaseSnapshot(psnapshot);
+}
+
+namespace {
+
+struct CCoinsStatsRange
+{
+    uint256 hashStart;
+    uint256 hashEnd;
+    bool fLast;
+    CCoinsStats stats;
+    bool fOk;
+
+    CCoinsStatsRange() : fLast(false), fOk(false) {}
+};
+
+void GetStatsRange(CDBWrapper &db, const leveldb::Snapshot *psnapshot, CCoinsStatsRange &range)
+{
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator(psnapshot));
+    COutPoint outpoint(range.hashStart, 0);
+    CoinEntry key(&outpoint);
+    uint256 hashPrev;
+    for (pcursor->Seek(key); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        if (!pcursor->GetKey(key) || key.key != DB_COIN || (!range.fLast && !(outpoint.hash < range.hashEnd)))
+            break;
+        Coin coin;
+        if (!pcursor->GetValue(coin)) {
+            error("%s: unable to read value", __func__);
+            return;
+        }
+        // Outputs of a transaction are adjacent, and never split across ranges
+        if (range.stats.nTransactionOutputs == 0 || outpoint.hash != hashPrev)
+            range.stats.nTransactions++;
+        hashPrev = outpoint.hash;
+        range.stats.Add(outpoint, coin, pcursor->GetValueSize());
+    }
+    range.fOk = true;
+}
+
+}
+
+bool CCoinsViewDBSnapshot::GetStats(CCoinsStats &stats, int nThreads) const
+{
+    nThreads = std::max(1, std::min(nThreads, 256));
+
+    // Keys are ordered by the first byte of the txid, so split on it
+    std::vector<CCoinsStatsRange> vRanges(nThreads);
+    for (int i = 0; i < nThreads; i++) {
+        *vRanges[i].hashStart.begin() = i * 256 / nThreads;
+        if (i + 1 < nThreads)
+            *vRanges[i].hashEnd.begin() = (i + 1) * 256 / nThreads;
+        else
+            vRanges[i].fLast = true;
+    }
+
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&GetStatsRange, boost::ref(db), psnapshot, boost::ref(vRanges[i])));
+    try {
+        threadGroup.join_all();
+    } catch (const boost::thread_interrupted&) {
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+        throw;
+    }
+
+    stats.hashBlock = hashBlock;
+    for (const CCoinsStatsRange &range : vRanges) {
+        if (!range.fOk)
+            return false;
+        stats.Add(range.stats);
+    }
+    return true;
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -161,6 +547,14 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadBlockStats(int nHeight, CBlockStats &stats) {
+    return Read(std::make_pair(DB_BLOCK_STATS, nHeight), stats);
+}
+
+bool CBlockTreeDB::WriteBlockStats(const CBlockStats &stats) {
+    return Write(std::make_pair(DB_BLOCK_STATS, stats.nHeight), stats);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -173,21 +567,130 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+namespace {
+
+typedef std::vector<std::pair<uint256, CDiskBlockIndex> > CBlockIndexBatch;
+
+//! Entries the loading threads hand to the inserting thread at once
+static const size_t BLOCK_INDEX_BATCH_SIZE = 1024;
+
+/** Batches of block index entries read, waiting to be inserted */
+class CBlockIndexLoadQueue
 {
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+private:
+    std::mutex cs;
+    std::condition_variable cond;
+    std::deque<CBlockIndexBatch> batches;
+    size_t nMaxBatches;
+    int nRunning;
+    bool fFailed;
+    bool fStop;
+
+public:
+    explicit CBlockIndexLoadQueue(int nThreads) : nMaxBatches(2 * nThreads), nRunning(nThreads), fFailed(false), fStop(false) {}
+
+    //! Hand over batch once there is room for it; false if loading was stopped
+    bool Push(CBlockIndexBatch& batch)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        cond.wait(lock, [this]{ return fStop || batches.size() < nMaxBatches; });
+        if (fStop)
+            return false;
+        batches.push_back(std::move(batch));
+        batch.clear();
+        cond.notify_all();
+        return true;
+    }
 
-    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
+    //! Called by each loading thread when its range is done
+    void Finish(bool fOk)
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        nRunning--;
+        fFailed |= !fOk;
+        cond.notify_all();
+    }
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
+    //! Next batch to insert; false once every loading thread is done
+    bool Pop(CBlockIndexBatch& batch)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        cond.wait(lock, [this]{ return !batches.empty() || nRunning == 0; });
+        if (batches.empty())
+            return false;
+        batch = std::move(batches.front());
+        batches.pop_front();
+        cond.notify_all();
+        return true;
+    }
+
+    void Stop()
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+        cond.notify_all();
+    }
+
+    bool Failed()
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        return fFailed;
+    }
+};
+
+void LoadBlockIndexRange(CDBWrapper &db, const uint256 &hashStart, const uint256 &hashEnd, bool fLast, CBlockIndexLoadQueue &queue)
+{
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    std::pair<char, uint256> key(DB_BLOCK_INDEX, hashStart);
+    CBlockIndexBatch batch;
+    bool fOk = true;
+    for (pcursor->Seek(key); pcursor->Valid(); pcursor->Next()) {
         boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || (!fLast && !(key.second < hashEnd)))
+            break;
+        batch.emplace_back();
+        CDiskBlockIndex& diskindex = batch.back().second;
+        if (!pcursor->GetValue(diskindex)) {
+            fOk = error("LoadBlockIndex() : failed to read value");
+            break;
+        }
+        batch.back().first = diskindex.GetBlockHash();
+        diskindex.nChainWork = GetBlockProof(diskindex);
+        if (batch.size() == BLOCK_INDEX_BATCH_SIZE && !queue.Push(batch))
+            break;
+    }
+    if (!batch.empty() && fOk)
+        queue.Push(batch);
+    queue.Finish(fOk);
+}
+
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex, int nThreads)
+{
+    nThreads = std::max(1, std::min(nThreads, 256));
+    CBlockIndexLoadQueue queue(nThreads);
+
+    // Keys are ordered by the first byte of the block hash, so split on it
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads; i++) {
+        uint256 hashStart, hashEnd;
+        *hashStart.begin() = i * 256 / nThreads;
+        if (i + 1 < nThreads)
+            *hashEnd.begin() = (i + 1) * 256 / nThreads;
+        threadGroup.create_thread(boost::bind(&LoadBlockIndexRange, boost::ref(*this), hashStart, hashEnd, i + 1 == nThreads, boost::ref(queue)));
+    }
+
+    // Load mapBlockIndex
+    try {
+        CBlockIndexBatch batch;
+        while (queue.Pop(batch)) {
+            boost::this_thread::interruption_point();
+            for (const std::pair<uint256, CDiskBlockIndex>& entry : batch) {
+                const CDiskBlockIndex& diskindex = entry.second;
+
                 // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
+                CBlockIndex* pindexNew = insertBlockIndex(entry.first);
                 pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
                 pindexNew->nHeight        = diskindex.nHeight;
                 pindexNew->nFile          = diskindex.nFile;
@@ -200,20 +703,21 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
                 pindexNew->nNonce         = diskindex.nNonce;
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
+                pindexNew->nChainWork     = diskindex.nChainWork;
 
                 /* Bitcoin checks the PoW here.  We don't do this because
                    the CDiskBlockIndex does not contain the auxpow.
                    This check isn't important, since the data on disk should
                    already be valid and can be trusted.  */
-
-                pcursor->Next();
-            } else {
-                return error("LoadBlockIndex() : failed to read value");
             }
-        } else {
-            break;
         }
+    } catch (...) {
+        queue.Stop();
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+        throw;
     }
+    threadGroup.join_all();
 
-    return true;
+    return !queue.Failed();
 }
@@ -10,14 +10,19 @@
 #include "dbwrapper.h"
 #include "chain.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include <boost/function.hpp>
 
 class CBlockIndex;
+class CBlockStats;
 class CCoinsViewDBCursor;
 class uint256;
 
@@ -41,6 +46,12 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! -backgroundflush default
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
+//! -dbcachekeep default (percent of the in-memory UTXO set)
+static const int DEFAULT_DBCACHE_KEEP = 30;
+//! max. -dbcachekeep, below the smallest size at which the cache is written again
+static const int MAX_DBCACHE_KEEP = 40;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -67,19 +78,89 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/**
+ * CCoinsView backed by the coin database (chainstate/)
+ *
+ * With fBackgroundFlush, BatchWrite only takes over the flushed map, and a
+ * background thread writes it together with the new best block in one
+ * atomic batch. Until that has completed the map is still read through
+ * this view, so the cache above can continue from empty right away. Only
+ * one batch is written at a time; the next BatchWrite waits for it.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
 public:
-    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool fBackgroundFlushIn = false, const CDBOptions& dbopts = CDBOptions());
+    ~CCoinsViewDB();
 
-    bool GetCoins(const uint256 &txid, CCoins &coins) const;
-    bool HaveCoins(const uint256 &txid) const;
+    //! The underlying database, for reporting its LevelDB properties
+    const CDBWrapper& GetDB() const { return db; }
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool HaveCoin(const COutPoint &outpoint) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     CCoinsViewCursor *Cursor() const;
+
+    //! Convert per-transaction records of an older database to per-output ones. Returns false on error or if interrupted.
+    bool Upgrade();
+
+    bool HasBackgroundFlush() const { return fBackgroundFlush; }
+    //! Whether a batch is still being written in the background
+    bool IsFlushing() const;
+    //! Whether writing a batch in the background failed
+    bool FlushFailed() const;
+    //! Wait until the batch being written in the background, if any, is on disk. Returns false if writing it failed.
+    bool SyncFlush() const;
+    //! Memory used by the batch being written in the background
+    size_t FlushingMemoryUsage() const { return nFlushingUsage; }
+
+private:
+    //! Write the dirty entries of mapCoins and the new best block in one batch
+    bool WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock);
+    void ThreadFlush();
+
+    const bool fBackgroundFlush;
+    mutable std::mutex csFlush;
+    mutable std::condition_variable condFlush;
+    //! Batch taken over by BatchWrite that is not on disk yet (protected by csFlush, not modified while being written)
+    CCoinsMap mapFlushing;
+    uint256 hashFlushing;
+    bool fFlushPending;
+    bool fFlushFailed;
+    bool fFlushStop;
+    std::atomic<size_t> nFlushingUsage;
+    std::thread threadFlush;
+
+    friend class CCoinsViewDBSnapshot;
+};
+
+/** Consistent read-only view of the coin database as it was when created */
+class CCoinsViewDBSnapshot
+{
+public:
+    explicit CCoinsViewDBSnapshot(const CCoinsViewDB &view);
+    ~CCoinsViewDBSnapshot();
+
+    //! Get the best block of the snapshot
+    const uint256 &GetBestBlock() const { return hashBlock; }
+
+    /**
+     * Calculate statistics about the unspent transaction output set,
+     * scanning nThreads disjoint txid ranges in parallel. hashSerialized is
+     * not computed, as it is defined over the whole set in order.
+     */
+    bool GetStats(CCoinsStats &stats, int nThreads) const;
+
+private:
+    CDBWrapper &db;
+    const leveldb::Snapshot *psnapshot;
+    uint256 hashBlock;
+
+    CCoinsViewDBSnapshot(const CCoinsViewDBSnapshot&);
+    void operator=(const CCoinsViewDBSnapshot&);
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -88,8 +169,8 @@ class CCoinsViewDBCursor: public CCoinsViewCursor
 public:
     ~CCoinsViewDBCursor() {}
 
-    bool GetKey(uint256 &key) const;
-    bool GetValue(CCoins &coins) const;
+    bool GetKey(COutPoint &key) const;
+    bool GetValue(Coin &coin) const;
     unsigned int GetValueSize() const;
 
     bool Valid() const;
@@ -99,7 +180,7 @@ private:
     CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
         CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
     std::unique_ptr<CDBIterator> pcursor;
-    std::pair<char, uint256> keyTmp;
+    std::pair<char, COutPoint> keyTmp;
 
     friend class CCoinsViewDB;
 };
@@ -108,7 +189,7 @@ private:
 class CBlockTreeDB : public CDBWrapper
 {
 public:
-    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CDBOptions& dbopts = CDBOptions());
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
@@ -120,9 +201,17 @@ public:
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool ReadBlockStats(int nHeight, CBlockStats &stats);
+    bool WriteBlockStats(const CBlockStats &stats);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /**
+     * Read the block index on nThreads threads, each covering a range of
+     * hashes, and insert it on the calling thread. Each entry's nChainWork is
+     * set to the work of the block alone, computed on the reading threads;
+     * the caller accumulates it along the chain.
+     */
+    bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex, int nThreads);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -56,6 +56,44 @@ signed char HexDigit(char c)
     return p_util_hexdigit[(unsigned char)c];
 }
 
+namespace {
+/** Both hex digits of every byte value, so each byte takes one lookup */
+struct HexPairs
+{
+    char pairs[256][2];
+
+    HexPairs()
+    {
+        static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
+                                         '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+        for (int i = 0; i < 256; i++) {
+            pairs[i][0] = hexmap[i >> 4];
+            pairs[i][1] = hexmap[i & 15];
+        }
+    }
+};
+}
+
+void HexEncode(char* psz, const unsigned char* pch, size_t nSize)
+{
+    static const HexPairs hex;
+    // Eight bytes per iteration, without branches, so the table loads and
+    // two-byte stores are scheduled back to back.
+    size_t i = 0;
+    for (; i + 8 <= nSize; i += 8, psz += 16) {
+        memcpy(psz, hex.pairs[pch[i]], 2);
+        memcpy(psz + 2, hex.pairs[pch[i + 1]], 2);
+        memcpy(psz + 4, hex.pairs[pch[i + 2]], 2);
+        memcpy(psz + 6, hex.pairs[pch[i + 3]], 2);
+        memcpy(psz + 8, hex.pairs[pch[i + 4]], 2);
+        memcpy(psz + 10, hex.pairs[pch[i + 5]], 2);
+        memcpy(psz + 12, hex.pairs[pch[i + 6]], 2);
+        memcpy(psz + 14, hex.pairs[pch[i + 7]], 2);
+    }
+    for (; i < nSize; i++, psz += 2)
+        memcpy(psz, hex.pairs[pch[i]], 2);
+}
+
 bool IsHex(const string& str)
 {
     for(std::string::const_iterator it(str.begin()); it != str.end(); ++it)
@@ -41,6 +41,11 @@ std::vector<unsigned char> ParseHex(const char* psz);
 std::vector<unsigned char> ParseHex(const std::string& str);
 signed char HexDigit(char c);
 bool IsHex(const std::string& str);
+/**
+ * Hex encode the nSize bytes at pch into the 2 * nSize chars at psz, which
+ * is not terminated. Faster than HexStr for large buffers such as blocks.
+ */
+void HexEncode(char* psz, const unsigned char* pch, size_t nSize);
 std::vector<unsigned char> DecodeBase64(const char* p, bool* pfInvalid = NULL);
 std::string DecodeBase64(const std::string& str);
 std::string EncodeBase64(const unsigned char* pch, size_t len);
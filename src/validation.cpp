@@ -7,18 +7,24 @@
 #include "validation.h"
 
 #include "arith_uint256.h"
+#include "auxpowcache.h"
+#include "blockfilemap.h"
+#include "blockstats.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
+#include "crypto/scrypt.h"
 #include "lebowskiscoin.h"
 #include "lebowskiscoin-fees.h"
 #include "hash.h"
 #include "init.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
+#include "powcache.h"
 #include "pow.h"
 #include "primitives/block.h"
 #include "primitives/pureheader.h"
@@ -40,7 +46,11 @@
 #include "warnings.h"
 
 #include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -61,6 +71,8 @@
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+//! Arena the CBlockIndex entries of mapBlockIndex are allocated from (protected by cs_main)
+static PoolResource blockIndexPool;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
 CWaitableCriticalSection csBestBlock;
@@ -69,6 +81,7 @@ int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 bool fReindex = false;
 bool fTxIndex = false;
+bool fBlockStatsIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -76,6 +89,7 @@ bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+int nCoinCacheKeep = DEFAULT_DBCACHE_KEEP;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
@@ -94,6 +108,8 @@ CTxMemPool mempool(::minRelayTxFeeRate);
  */
 static bool IsSuperMajority(int minVersion, const CBlockIndex* pstart, unsigned nRequired, const Consensus::Params& consensusParams);
 static void CheckBlockIndex(const Consensus::Params& consensusParams);
+static bool CheckInputsForMempool(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, unsigned int flags, PrecomputedTransactionData& txdata);
+static void CheckBatchScripts(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx, const std::vector<size_t>& vOrder, std::vector<std::vector<COutPoint> >& vCoinsToUncache);
 
 /** Constant stuff for coinbase transactions we create: */
 CScript COINBASE_FLAGS;
@@ -241,6 +257,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache *pcoinsTip = NULL;
+CCoinsViewDB *pcoinsdbview = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
 enum FlushStateMode {
@@ -429,15 +446,15 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
         prevheights.resize(tx.vin.size());
         for (size_t txinIndex = 0; txinIndex < tx.vin.size(); txinIndex++) {
             const CTxIn& txin = tx.vin[txinIndex];
-            CCoins coins;
-            if (!viewMemPool.GetCoins(txin.prevout.hash, coins)) {
+            Coin coin;
+            if (!viewMemPool.GetCoin(txin.prevout, coin)) {
                 return error("%s: Missing input", __func__);
             }
-            if (coins.nHeight == MEMPOOL_HEIGHT) {
+            if (coin.nHeight == MEMPOOL_HEIGHT) {
                 // Assume all mempool transaction confirm in the next block
                 prevheights[txinIndex] = tip->nHeight + 1;
             } else {
-                prevheights[txinIndex] = coins.nHeight;
+                prevheights[txinIndex] = coin.nHeight;
             }
         }
         lockPair = CalculateSequenceLocks(tx, flags, &prevheights, index);
@@ -493,7 +510,9 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& in
     unsigned int nSigOps = 0;
     for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
-        const CTxOut &prevout = inputs.GetOutputFor(tx.vin[i]);
+        const Coin& coin = inputs.AccessCoin(tx.vin[i].prevout);
+        assert(!coin.IsSpent());
+        const CTxOut &prevout = coin.out;
         if (prevout.scriptPubKey.IsPayToScriptHash())
             nSigOps += prevout.scriptPubKey.GetSigOpCount(tx.vin[i].scriptSig);
     }
@@ -513,7 +532,9 @@ int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& i
 
     for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
-        const CTxOut &prevout = inputs.GetOutputFor(tx.vin[i]);
+        const Coin& coin = inputs.AccessCoin(tx.vin[i].prevout);
+        assert(!coin.IsSpent());
+        const CTxOut &prevout = coin.out;
         nSigOps += CountWitnessSigOps(tx.vin[i].scriptSig, prevout.scriptPubKey, &tx.vin[i].scriptWitness, flags);
     }
     return nSigOps;
@@ -578,9 +599,9 @@ void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
     if (expired != 0)
         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
 
-    std::vector<uint256> vNoSpendsRemaining;
+    std::vector<COutPoint> vNoSpendsRemaining;
     pool.TrimToSize(limit, &vNoSpendsRemaining);
-    BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
+    BOOST_FOREACH(const COutPoint& removed, vNoSpendsRemaining)
         pcoinsTip->Uncache(removed);
 }
 
@@ -593,6 +614,16 @@ std::string FormatStateMessage(const CValidationState &state)
         state.GetRejectCode());
 }
 
+/** Script verification flags for transactions entering the mempool */
+static unsigned int GetMempoolScriptVerifyFlags()
+{
+    unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!Params().RequireStandard()) {
+        scriptVerifyFlags = GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+    }
+    return scriptVerifyFlags;
+}
+
 static bool IsCurrentForFeeEstimation()
 {
     AssertLockHeld(cs_main);
@@ -607,7 +638,7 @@ static bool IsCurrentForFeeEstimation()
 
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool fLimitFree,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<uint256>& vHashTxnToUncache)
+                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<COutPoint>& vCoinsToUncache)
 {
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
@@ -700,30 +731,34 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         view.SetBackend(viewMemPool);
 
         // do we already have it?
-        bool fHadTxInCache = pcoinsTip->HaveCoinsInCache(hash);
-        if (view.HaveCoins(hash)) {
-            if (!fHadTxInCache)
-                vHashTxnToUncache.push_back(hash);
-            return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
+        for (size_t out = 0; out < tx.vout.size(); out++) {
+            COutPoint outpoint(hash, out);
+            bool fHadCoinInCache = pcoinsTip->HaveCoinInCache(outpoint);
+            if (view.HaveCoin(outpoint)) {
+                if (!fHadCoinInCache)
+                    vCoinsToUncache.push_back(outpoint);
+                return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
+            }
         }
 
         // do all inputs exist?
-        // Note that this does not check for the presence of actual outputs (see the next check for that),
-        // and only helps with filling in pfMissingInputs (to determine missing vs spent).
         BOOST_FOREACH(const CTxIn txin, tx.vin) {
-            if (!pcoinsTip->HaveCoinsInCache(txin.prevout.hash))
-                vHashTxnToUncache.push_back(txin.prevout.hash);
-            if (!view.HaveCoins(txin.prevout.hash)) {
+            if (!pcoinsTip->HaveCoinInCache(txin.prevout))
+                vCoinsToUncache.push_back(txin.prevout);
+            if (!view.HaveCoin(txin.prevout)) {
+                // Are inputs missing because we already have the tx?
+                for (size_t out = 0; out < tx.vout.size(); out++) {
+                    // Optimistically just do efficient check of cache for outputs
+                    if (pcoinsTip->HaveCoinInCache(COutPoint(hash, out)))
+                        return state.Invalid(false, REJECT_DUPLICATE, "txn-already-known");
+                }
+                // Otherwise assume this might be an orphan tx for which we just haven't seen parents yet
                 if (pfMissingInputs)
                     *pfMissingInputs = true;
                 return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
             }
         }
 
-        // are the actual inputs available?
-        if (!view.HaveInputs(tx))
-            return state.Invalid(false, REJECT_DUPLICATE, "bad-txns-inputs-spent");
-
         // Bring the best block into scope
         view.GetBestBlock();
 
@@ -765,8 +800,8 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         // during reorgs to ensure COINBASE_MATURITY is still met.
         bool fSpendsCoinbase = false;
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            const CCoins *coins = view.AccessCoins(txin.prevout.hash);
-            if (coins->IsCoinBase()) {
+            const Coin &coin = view.AccessCoin(txin.prevout);
+            if (coin.IsCoinBase()) {
                 fSpendsCoinbase = true;
                 break;
             }
@@ -976,15 +1011,12 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
             }
         }
 
-        unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
-        if (!Params().RequireStandard()) {
-            scriptVerifyFlags = GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
-        }
+        unsigned int scriptVerifyFlags = GetMempoolScriptVerifyFlags();
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, txdata)) {
+        if (!CheckInputsForMempool(tx, state, view, scriptVerifyFlags, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
@@ -1006,7 +1038,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, txdata))
+        if (!CheckInputsForMempool(tx, state, view, MANDATORY_SCRIPT_VERIFY_FLAGS, txdata))
         {
             return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
                 __func__, hash.ToString(), FormatStateMessage(state));
@@ -1051,11 +1083,11 @@ bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
                         bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
 {
-    std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache);
+    std::vector<COutPoint> vCoinsToUncache;
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, vCoinsToUncache);
     if (!res) {
-        BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
-            pcoinsTip->Uncache(hashTx);
+        BOOST_FOREACH(const COutPoint& outpoint, vCoinsToUncache)
+            pcoinsTip->Uncache(outpoint);
     }
     // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
     CValidationState stateDummy;
@@ -1070,6 +1102,87 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee);
 }
 
+/**
+ * Order a batch of transactions so that every transaction comes after the
+ * transactions of the batch whose outputs it spends, keeping the original
+ * order where it does not matter. Returns indexes into vtx.
+ */
+static std::vector<size_t> SortBatchByDependencies(const std::vector<CTransactionRef>& vtx)
+{
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = 0; i < vtx.size(); i++)
+        mapIndex.insert(std::make_pair(vtx[i]->GetHash(), i));
+
+    std::vector<size_t> vParents(vtx.size(), 0);
+    std::vector<std::vector<size_t> > vChildren(vtx.size());
+    for (size_t i = 0; i < vtx.size(); i++) {
+        for (const CTxIn& txin : vtx[i]->vin) {
+            auto it = mapIndex.find(txin.prevout.hash);
+            if (it != mapIndex.end() && it->second != i) {
+                vParents[i]++;
+                vChildren[it->second].push_back(i);
+            }
+        }
+    }
+
+    std::set<size_t> setReady;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vParents[i] == 0)
+            setReady.insert(i);
+    }
+    std::vector<size_t> vOrder;
+    vOrder.reserve(vtx.size());
+    while (!setReady.empty()) {
+        const size_t i = *setReady.begin();
+        setReady.erase(setReady.begin());
+        vOrder.push_back(i);
+        for (size_t child : vChildren[i]) {
+            if (--vParents[child] == 0)
+                setReady.insert(child);
+        }
+    }
+    return vOrder;
+}
+
+unsigned int AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx, std::vector<CValidationState>& vState,
+                        std::vector<bool>& vAccepted, bool fLimitFree, std::vector<bool>* pvMissingInputs,
+                        const std::vector<int64_t>* pvAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
+                        const CAmount nAbsurdFee)
+{
+    AssertLockHeld(cs_main);
+    vState.assign(vtx.size(), CValidationState());
+    vAccepted.assign(vtx.size(), false);
+    if (pvMissingInputs)
+        pvMissingInputs->assign(vtx.size(), false);
+
+    const std::vector<size_t> vOrder = SortBatchByDependencies(vtx);
+    std::vector<std::vector<COutPoint> > vCoinsToUncache(vtx.size());
+    if (nScriptCheckThreads)
+        CheckBatchScripts(pool, vtx, vOrder, vCoinsToUncache);
+
+    unsigned int nAccepted = 0;
+    for (size_t i : vOrder) {
+        bool fMissingInputs = false;
+        const int64_t nAcceptTime = pvAcceptTime ? (*pvAcceptTime)[i] : GetTime();
+        vAccepted[i] = AcceptToMemoryPoolWorker(pool, vState[i], vtx[i], fLimitFree, &fMissingInputs, nAcceptTime, plTxnReplaced, false, nAbsurdFee, vCoinsToUncache[i]);
+        if (vAccepted[i])
+            nAccepted++;
+        if (pvMissingInputs)
+            (*pvMissingInputs)[i] = fMissingInputs;
+    }
+
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (!vAccepted[i]) {
+            BOOST_FOREACH(const COutPoint& outpoint, vCoinsToUncache[i])
+                pcoinsTip->Uncache(outpoint);
+        }
+    }
+    // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
+    CValidationState stateDummy;
+    FlushStateToDisk(stateDummy, FLUSH_STATE_PERIODIC);
+    return nAccepted;
+}
+
 /** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1108,10 +1221,9 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus
     if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
         int nHeight = -1;
         {
-            const CCoinsViewCache& view = *pcoinsTip;
-            const CCoins* coins = view.AccessCoins(hash);
-            if (coins)
-                nHeight = coins->nHeight;
+            const Coin& coin = AccessByTxid(*pcoinsTip, hash);
+            if (!coin.IsSpent())
+                nHeight = coin.nHeight;
         }
         if (nHeight > 0)
             pindexSlow = chainActive[nHeight];
@@ -1167,29 +1279,68 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
 /* Generic implementation of block reading that can handle
    both a block and its header.  */
 
+/** Mapping of the block file holding pos, if that file is no longer appended to. */
+static std::shared_ptr<const CMappedFile> MapBlockFile(const CDiskBlockPos& pos)
+{
+    if (pos.IsNull())
+        return NULL;
+    {
+        LOCK(cs_LastBlockFile);
+        if (pos.nFile >= nLastBlockFile)
+            return NULL;
+    }
+    return blockFileMaps.Get(pos.nFile, GetBlockPosFilename(pos, "blk").string());
+}
+
+/** Locate the block stored at pos inside a mapped block file, using the size written before it. */
+static bool GetMappedBlock(const CMappedFile& mapped, const CDiskBlockPos& pos, const unsigned char*& pchBlock, unsigned int& nSize)
+{
+    if (pos.nPos < sizeof(nSize) || pos.nPos > mapped.size())
+        return false;
+    nSize = ReadLE32(mapped.data() + pos.nPos - sizeof(nSize));
+    if (nSize > mapped.size() - pos.nPos)
+        return false;
+    pchBlock = mapped.data() + pos.nPos;
+    return true;
+}
+
 template<typename T>
 static bool ReadBlockOrHeader(T& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    std::shared_ptr<const CMappedFile> mapped = MapBlockFile(pos);
+    const unsigned char* pchBlock;
+    unsigned int nSize;
+    if (mapped && GetMappedBlock(*mapped, pos, pchBlock, nSize)) {
+        // Deserialize straight from the mapped file
+        try {
+            CSpanReader reader(SER_DISK, CLIENT_VERSION, pchBlock, nSize);
+            reader >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
 
 
 
     // Check the header
-    if (fCheckPOW && !CheckAuxPowProofOfWork(block, consensusParams))
+    if (fCheckPOW && !CheckAuxPowProofOfWorkCached(block, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
 
     return true;
@@ -1203,6 +1354,8 @@ static bool ReadBlockOrHeader(T& block, const CBlockIndex* pindex, const Consens
     if (block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockOrHeader(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
                 pindex->ToString(), pindex->GetBlockPos().ToString());
+    if (block.auxpow)
+        auxpowHeaderCache.Insert(pindex->GetBlockHash(), *block.auxpow);
     return true;
 }
 
@@ -1216,6 +1369,78 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return ReadBlockOrHeader(block, pindex, consensusParams, fCheckPOW);
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    vchBlock.clear();
+
+    std::shared_ptr<const CMappedFile> mapped = MapBlockFile(pos);
+    const unsigned char* pchBlock;
+    unsigned int nSize;
+    if (mapped && GetMappedBlock(*mapped, pos, pchBlock, nSize)) {
+        vchBlock.assign(pchBlock, pchBlock + nSize);
+        return true;
+    }
+
+    // Open history file at the index header written before the block
+    if (pos.nPos < CMessageHeader::MESSAGE_START_SIZE + sizeof(nSize))
+        return error("%s: invalid position %s", __func__, pos.ToString());
+    CDiskBlockPos posHeader(pos.nFile, pos.nPos - CMessageHeader::MESSAGE_START_SIZE - sizeof(nSize));
+    CAutoFile filein(OpenBlockFile(posHeader, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    try {
+        CMessageHeader::MessageStartChars blk_start;
+        filein >> FLATDATA(blk_start) >> nSize;
+        if (memcmp(blk_start, messageStart, CMessageHeader::MESSAGE_START_SIZE))
+            return error("%s: block magic mismatch at %s", __func__, pos.ToString());
+        if (nSize > MAX_BLOCK_SERIALIZED_SIZE)
+            return error("%s: invalid block size %u at %s", __func__, nSize, pos.ToString());
+        vchBlock.resize(nSize);
+        filein.read((char*)vchBlock.data(), nSize);
+    }
+    catch (const std::exception& e) {
+        vchBlock.clear();
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
+uint256 GetRawBlockHash(const std::vector<unsigned char>& vchBlock)
+{
+    CPureBlockHeader header;
+    try {
+        CSpanReader(SER_DISK, CLIENT_VERSION, vchBlock.data(), vchBlock.size()) >> header;
+    } catch (const std::exception&) {
+        return uint256();
+    }
+    return header.GetHash();
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    if (!ReadRawBlockFromDisk(vchBlock, pindex->GetBlockPos(), messageStart))
+        return false;
+    if (GetRawBlockHash(vchBlock) != pindex->GetBlockHash())
+        return error("ReadRawBlockFromDisk(CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                pindex->ToString(), pindex->GetBlockPos().ToString());
+    return true;
+}
+
+bool IsStoredBlockSerialization(const CBlockIndex* pindex, int nSerFlags)
+{
+    // Blocks are written with witness serialization, which only differs
+    // from the one without for blocks that may contain witness data.
+    if (!(nSerFlags & SERIALIZE_TRANSACTION_NO_WITNESS))
+        return true;
+    return !IsWitnessEnabled(pindex->pprev, Params().GetConsensus(pindex->nHeight));
+}
+
+bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW)
+{
+    return ReadBlockOrHeader(block, pos, consensusParams, fCheckPOW);
+}
+
 bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fCheckPOW)
 {
     return ReadBlockOrHeader(block, pindex, consensusParams, fCheckPOW);
@@ -1380,24 +1605,14 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txund
     if (!tx.IsCoinBase()) {
         txundo.vprevout.reserve(tx.vin.size());
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
-            unsigned nPos = txin.prevout.n;
-
-            if (nPos >= coins->vout.size() || coins->vout[nPos].IsNull())
-                assert(false);
             // mark an outpoint spent, and construct undo information
-            txundo.vprevout.push_back(CTxInUndo(coins->vout[nPos]));
-            coins->Spend(nPos);
-            if (coins->vout.size() == 0) {
-                CTxInUndo& undo = txundo.vprevout.back();
-                undo.nHeight = coins->nHeight;
-                undo.fCoinBase = coins->fCoinBase;
-                undo.nVersion = coins->nVersion;
-            }
+            txundo.vprevout.emplace_back();
+            bool is_spent = inputs.SpendCoin(txin.prevout, &txundo.vprevout.back());
+            assert(is_spent);
         }
     }
     // add outputs
-    inputs.ModifyNewCoins(tx.GetHash(), tx.IsCoinBase())->FromTx(tx, nHeight);
+    AddCoins(inputs, tx, nHeight);
 }
 
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
@@ -1415,6 +1630,46 @@ bool CScriptCheck::operator()() {
     return true;
 }
 
+bool CMempoolScriptCheck::operator()() {
+    for (CScriptCheck& check : vChecks) {
+        if (!check())
+            break;
+    }
+    return true;
+}
+
+bool CCoinsPrefetch::operator()() {
+    try {
+        if (!pcoinsdbview->GetCoin(outpoint, *pcoin))
+            pcoin->Clear();
+    } catch (const std::exception&) {
+        pcoin->Clear();
+    }
+    return true;
+}
+
+bool CPowCheck::operator()() {
+    // Hash the headers carrying the proof of work (the parent blocks for
+    // auxpow) in one go, then do the remaining, cheap checks one by one.
+    std::vector<uint256> vPowHashes(vpheaders.size());
+    std::vector<const char*> vInputs(vpheaders.size());
+    std::vector<char*> vOutputs(vpheaders.size());
+    for (size_t i = 0; i < vpheaders.size(); i++) {
+        const CPureBlockHeader* pPowHeader = vpheaders[i];
+        if (vpheaders[i]->auxpow)
+            pPowHeader = &vpheaders[i]->auxpow->parentBlock;
+        vInputs[i] = BEGIN(pPowHeader->nVersion);
+        vOutputs[i] = BEGIN(vPowHashes[i]);
+    }
+    scrypt_1024_1_1_256_multi(vInputs.data(), vOutputs.data(), vpheaders.size());
+
+    for (size_t i = 0; i < vpheaders.size(); i++) {
+        if (!CheckAuxPowProofOfWorkCached(*vpheaders[i], *pparams, &vPowHashes[i]))
+            return false;
+    }
+    return true;
+}
+
 int GetSpendHeight(const CCoinsViewCache& inputs)
 {
     LOCK(cs_main);
@@ -1435,22 +1690,22 @@ bool CheckTxInputs(const CChainParams& params, const CTransaction& tx, CValidati
         for (unsigned int i = 0; i < tx.vin.size(); i++)
         {
             const COutPoint &prevout = tx.vin[i].prevout;
-            const CCoins *coins = inputs.AccessCoins(prevout.hash);
-            assert(coins);
+            const Coin& coin = inputs.AccessCoin(prevout);
+            assert(!coin.IsSpent());
 
             // If prev is coinbase, check that it's matured
-            if (coins->IsCoinBase()) {
+            if (coin.IsCoinBase()) {
                 // lebowskiscoin: Switch maturity at digishield activation
-                int nCoinbaseMaturity = params.GetConsensus(coins->nHeight).nCoinbaseMaturity;
-                if (nSpendHeight - coins->nHeight < nCoinbaseMaturity)
+                int nCoinbaseMaturity = params.GetConsensus(coin.nHeight).nCoinbaseMaturity;
+                if (nSpendHeight - coin.nHeight < nCoinbaseMaturity)
                     return state.Invalid(false,
                         REJECT_INVALID, "bad-txns-premature-spend-of-coinbase",
-                        strprintf("tried to spend coinbase at depth %d", nSpendHeight - coins->nHeight));
+                        strprintf("tried to spend coinbase at depth %d", nSpendHeight - coin.nHeight));
             }
 
             // Check for negative or overflow input values
-            nValueIn += coins->vout[prevout.n].nValue;
-            if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+            nValueIn += coin.out.nValue;
+            if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn))
                 return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputvalues-outofrange");
 
         }
@@ -1492,11 +1747,14 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         if (fScriptChecks) {
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const Coin& coin = inputs.AccessCoin(prevout);
+                assert(!coin.IsSpent());
+
+                const CScript& scriptPubKey = coin.out.scriptPubKey;
+                const CAmount amount = coin.out.nValue;
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore, &txdata);
+                CScriptCheck check(scriptPubKey, amount, tx, i, flags, cacheStore, &txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1508,7 +1766,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // arguments; if so, don't trigger DoS protection to
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
-                        CScriptCheck check2(*coins, tx, i,
+                        CScriptCheck check2(scriptPubKey, amount, tx, i,
                                 flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &txdata);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
@@ -1609,34 +1867,34 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
 } // anon namespace
 
 /**
- * Apply the undo operation of a CTxInUndo to the given chain state.
- * @param undo The undo object.
+ * Restore the UTXO in a Coin at a given COutPoint.
+ * @param undo The Coin to be restored.
  * @param view The coins view to which to apply the changes.
  * @param out The out point that corresponds to the tx input.
  * @return True on success.
  */
-bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out)
+bool ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 {
     bool fClean = true;
 
-    CCoinsModifier coins = view.ModifyCoins(out.hash);
-    if (undo.nHeight != 0) {
-        // undo data contains height: this is the last output of the prevout tx being spent
-        if (!coins->IsPruned())
-            fClean = fClean && error("%s: undo data overwriting existing transaction", __func__);
-        coins->Clear();
-        coins->fCoinBase = undo.fCoinBase;
-        coins->nHeight = undo.nHeight;
-        coins->nVersion = undo.nVersion;
-    } else {
-        if (coins->IsPruned())
-            fClean = fClean && error("%s: undo data adding output to missing transaction", __func__);
-    }
-    if (coins->IsAvailable(out.n))
+    if (view.HaveCoin(out))
         fClean = fClean && error("%s: undo data overwriting existing output", __func__);
-    if (coins->vout.size() < out.n+1)
-        coins->vout.resize(out.n+1);
-    coins->vout[out.n] = undo.txout;
+
+    if (undo.nHeight == 0) {
+        // Missing undo metadata (height and coinbase). Older versions included this
+        // information only in undo records for the last spend of a transactions'
+        // outputs. This implies that it must be present for some other output of the same tx.
+        const Coin& alternate = AccessByTxid(view, out.hash);
+        if (alternate.IsSpent())
+            return error("%s: undo data adding output to missing transaction", __func__);
+        undo.nHeight = alternate.nHeight;
+        undo.fCoinBase = alternate.fCoinBase;
+    }
+    // The potential_overwrite parameter to AddCoin is only allowed to be false if we know for
+    // sure that the coin did not already exist in the cache. As we have queried for that above
+    // using HaveCoin, we don't need to guess. When fClean is false, a coin already existed and
+    // it is an overwrite.
+    view.AddCoin(out, std::move(undo), !fClean);
 
     return fClean;
 }
@@ -1666,34 +1924,31 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
         const CTransaction &tx = *(block.vtx[i]);
         uint256 hash = tx.GetHash();
 
+        bool fCoinBase = tx.IsCoinBase();
+
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
-        {
-        CCoinsModifier outs = view.ModifyCoins(hash);
-        outs->ClearUnspendable();
-
-        CCoins outsBlock(tx, pindex->nHeight);
-        // The CCoins serialization does not serialize negative numbers.
-        // No network rules currently depend on the version here, so an inconsistency is harmless
-        // but it must be corrected before txout nversion ever influences a network rule.
-        if (outsBlock.nVersion < 0)
-            outs->nVersion = outsBlock.nVersion;
-        if (*outs != outsBlock)
-            fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
-
-        // remove outputs
-        outs->Clear();
+        bool fOutputsMatch = true;
+        for (size_t o = 0; o < tx.vout.size(); o++) {
+            if (!tx.vout[o].scriptPubKey.IsUnspendable()) {
+                COutPoint out(hash, o);
+                Coin coin;
+                bool is_spent = view.SpendCoin(out, &coin);
+                if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != (int)coin.nHeight || fCoinBase != (bool)coin.fCoinBase)
+                    fOutputsMatch = false;
+            }
         }
+        if (!fOutputsMatch)
+            fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
 
         // restore inputs
         if (i > 0) { // not coinbases
-            const CTxUndo &txundo = blockUndo.vtxundo[i-1];
+            CTxUndo &txundo = blockUndo.vtxundo[i-1];
             if (txundo.vprevout.size() != tx.vin.size())
                 return error("DisconnectBlock(): transaction and undo data inconsistent");
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
-                const CTxInUndo &undo = txundo.vprevout[j];
-                if (!ApplyTxInUndo(undo, view, out))
+                if (!ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out))
                     fClean = false;
             }
         }
@@ -1742,6 +1997,215 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/**
+ * CheckInputs for mempool admission (with cacheStore), spreading the script
+ * checks of transactions with several inputs over the script-checking
+ * threads. These are otherwise idle between blocks, and both users of the
+ * queue hold cs_main. The queue only tells whether all checks passed, so a
+ * failing transaction is checked again serially to fill in state; the
+ * signatures that did verify are in the signature cache by then.
+ */
+static bool CheckInputsForMempool(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, unsigned int flags, PrecomputedTransactionData& txdata)
+{
+    AssertLockHeld(cs_main);
+    if (nScriptCheckThreads && tx.vin.size() >= MIN_PARALLEL_MEMPOOL_SCRIPT_CHECKS) {
+        std::vector<CScriptCheck> vChecks;
+        if (!CheckInputs(tx, state, view, true, flags, true, txdata, &vChecks))
+            return false;
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(vChecks);
+        if (control.Wait())
+            return true;
+    }
+    return CheckInputs(tx, state, view, true, flags, true, txdata);
+}
+
+static CCheckQueue<CMempoolScriptCheck> mempoolscriptcheckqueue(16);
+
+void ThreadMempoolScriptCheck() {
+    RenameThread("lebowskiscoin-mpscriptch");
+    mempoolscriptcheckqueue.Thread();
+}
+
+/**
+ * Check the scripts of a batch of transactions on the mempool script check
+ * threads, taking inputs from the mempool and from earlier transactions of
+ * the batch, so that AcceptToMemoryPool finds the signatures in the cache
+ * when it accepts them one by one. Coins pulled into pcoinsTip's cache are
+ * recorded in vCoinsToUncache.
+ */
+static void CheckBatchScripts(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx, const std::vector<size_t>& vOrder, std::vector<std::vector<COutPoint> >& vCoinsToUncache)
+{
+    const unsigned int flags = GetMempoolScriptVerifyFlags();
+    // Referenced by the checks, so must not reallocate
+    std::vector<PrecomputedTransactionData> vTxData;
+    vTxData.reserve(vtx.size());
+    std::vector<CMempoolScriptCheck> vChecks;
+    {
+        LOCK(pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        CCoinsViewCache view(&viewMemPool);
+        for (size_t i : vOrder) {
+            const CTransaction& tx = *vtx[i];
+            const uint256 hash = tx.GetHash();
+            CValidationState stateDummy;
+            if (!CheckTransaction(tx, stateDummy) || tx.IsCoinBase() || pool.exists(hash))
+                continue;
+            bool fHaveTx = false;
+            for (size_t out = 0; out < tx.vout.size() && !fHaveTx; out++) {
+                const COutPoint outpoint(hash, out);
+                if (!pcoinsTip->HaveCoinInCache(outpoint))
+                    vCoinsToUncache[i].push_back(outpoint);
+                fHaveTx = view.HaveCoin(outpoint);
+            }
+            if (fHaveTx)
+                continue;
+
+            vTxData.emplace_back(tx);
+            std::vector<CScriptCheck> vTxChecks;
+            vTxChecks.reserve(tx.vin.size());
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const COutPoint& prevout = tx.vin[j].prevout;
+                if (!pcoinsTip->HaveCoinInCache(prevout))
+                    vCoinsToUncache[i].push_back(prevout);
+                const Coin& coin = view.AccessCoin(prevout);
+                if (coin.IsSpent())
+                    break;
+                vTxChecks.push_back(CScriptCheck());
+                CScriptCheck check(coin.out.scriptPubKey, coin.out.nValue, tx, j, flags, true, &vTxData.back());
+                check.swap(vTxChecks.back());
+            }
+            if (vTxChecks.size() < tx.vin.size())
+                continue;
+
+            // Make the outputs available to its children in the batch
+            UpdateCoins(tx, view, MEMPOOL_HEIGHT);
+            vChecks.emplace_back(vTxChecks);
+        }
+    }
+
+    CCheckQueueControl<CMempoolScriptCheck> control(&mempoolscriptcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
+static CCheckQueue<CCoinsPrefetch> coinsprefetchqueue(16);
+
+void ThreadCoinsPrefetch() {
+    RenameThread("lebowskiscoin-prefetch");
+    coinsprefetchqueue.Thread();
+}
+
+/**
+ * Read the inputs of a block that pcoinsTip does not have cached from the
+ * coin database on the prefetch threads, and add them to the cache, so that
+ * ConnectBlock does not wait for the reads one at a time. Inputs created
+ * earlier in the same block are not looked up. This must run between
+ * blocks: nothing may change pcoinsTip or the database while it reads.
+ */
+static void PrefetchBlockInputs(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (!nScriptCheckThreads)
+        return;
+    std::set<uint256> setBlockTxids;
+    std::vector<COutPoint> vOutPoints;
+    for (const CTransactionRef& tx : block.vtx) {
+        if (!tx->IsCoinBase()) {
+            for (const CTxIn& txin : tx->vin) {
+                if (!setBlockTxids.count(txin.prevout.hash) && !pcoinsTip->HaveCoinInCache(txin.prevout))
+                    vOutPoints.push_back(txin.prevout);
+            }
+        }
+        setBlockTxids.insert(tx->GetHash());
+    }
+    if (vOutPoints.size() < MIN_COINS_PREFETCH)
+        return;
+
+    std::vector<Coin> vCoins(vOutPoints.size());
+    std::vector<CCoinsPrefetch> vReads;
+    vReads.reserve(vOutPoints.size());
+    for (size_t i = 0; i < vOutPoints.size(); i++)
+        vReads.emplace_back(vOutPoints[i], &vCoins[i]);
+    CCheckQueueControl<CCoinsPrefetch> control(&coinsprefetchqueue);
+    control.Add(vReads);
+    control.Wait();
+
+    for (size_t i = 0; i < vOutPoints.size(); i++) {
+        if (!vCoins[i].IsSpent())
+            pcoinsTip->AddPrefetchedCoin(vOutPoints[i], std::move(vCoins[i]));
+    }
+}
+
+static CCheckQueue<CPowCheck> powcheckqueue(16);
+
+void ThreadPowCheck() {
+    RenameThread("lebowskiscoin-powch");
+    powcheckqueue.Thread();
+}
+
+namespace {
+/**
+ * Running UTXO set statistics for -utxostatsindex (protected by cs_main).
+ * Until seeded they only hold the changes made since the snapshot was
+ * taken; the counters wrap, so that is fine even when they are negative.
+ * The number of transactions is not tracked, as the set is kept per output.
+ */
+bool fUTXOStatsIndex = false;
+bool fUTXOStatsSeeded = false;
+CCoinsStats utxoStats;
+std::unique_ptr<CCoinsViewDBSnapshot> pUTXOStatsSnapshot;
+}
+
+/** Apply the changes a view is about to flush into pcoinsTip to the running UTXO set statistics */
+static void UpdateUTXOStats(const CCoinsViewCache& view)
+{
+    AssertLockHeld(cs_main);
+    if (!fUTXOStatsIndex)
+        return;
+    CCoinsStats added, removed;
+    view.GetStatsDelta(added, removed);
+    utxoStats.Add(added);
+    utxoStats.Subtract(removed);
+}
+
+void InitUTXOStatsIndex()
+{
+    LOCK(cs_main);
+    // Make the snapshot match pcoinsTip, from which the changes are tracked
+    FlushStateToDisk();
+    pUTXOStatsSnapshot.reset(new CCoinsViewDBSnapshot(*pcoinsdbview));
+    fUTXOStatsIndex = true;
+}
+
+void ThreadUTXOStatsIndex()
+{
+    RenameThread("lebowskiscoin-utxostats");
+    int64_t nStart = GetTimeMillis();
+    std::unique_ptr<CCoinsViewDBSnapshot> psnapshot(std::move(pUTXOStatsSnapshot));
+    CCoinsStats stats;
+    if (!psnapshot->GetStats(stats, GetNumCores())) {
+        LogPrintf("%s: unable to read UTXO set\n", __func__);
+        return;
+    }
+
+    LOCK(cs_main);
+    utxoStats.Add(stats);
+    fUTXOStatsSeeded = true;
+    LogPrintf("UTXO statistics index ready in %dms\n", GetTimeMillis() - nStart);
+}
+
+bool GetUTXOStatsIncremental(CCoinsStats &stats)
+{
+    LOCK(cs_main);
+    if (!fUTXOStatsSeeded)
+        return false;
+    stats = utxoStats;
+    stats.nHeight = chainActive.Height();
+    stats.hashBlock = pcoinsTip->GetBestBlock();
+    return true;
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1906,10 +2370,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (fEnforceBIP30) {
         for (const auto& tx : block.vtx) {
-            const CCoins* coins = view.AccessCoins(tx->GetHash());
-            if (coins && !coins->IsPruned())
-                return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
-                                 REJECT_INVALID, "bad-txns-BIP30");
+            for (size_t o = 0; o < tx->vout.size(); o++) {
+                if (view.HaveCoin(COutPoint(tx->GetHash(), o)))
+                    return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
+                                     REJECT_INVALID, "bad-txns-BIP30");
+            }
         }
     }
 
@@ -1984,7 +2449,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             // be in ConnectBlock because they require the UTXO set
             prevheights.resize(tx.vin.size());
             for (size_t j = 0; j < tx.vin.size(); j++) {
-                prevheights[j] = view.AccessCoins(tx.vin[j].prevout.hash)->nHeight;
+                prevheights[j] = view.AccessCoin(tx.vin[j].prevout).nHeight;
             }
 
             if (!SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex)) {
@@ -2065,6 +2530,13 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
+    if (fBlockStatsIndex) {
+        CBlockStats blockstats;
+        ComputeBlockStats(block, pindex, blockundo, blockstats);
+        if (!pblocktree->WriteBlockStats(blockstats))
+            return AbortNode(state, "Failed to write block statistics index");
+    }
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2099,6 +2571,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
     std::set<int> setFilesToPrune;
     bool fFlushForPrune = false;
     try {
+    if (pcoinsdbview->FlushFailed())
+        return AbortNode(state, "Failed to write to coin database");
     if (fPruneMode && (fCheckForPruning || nManualPruneHeight > 0) && !fReindex) {
         if (nManualPruneHeight > 0) {
             FindFilesToPruneManual(setFilesToPrune, nManualPruneHeight);
@@ -2127,12 +2601,21 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
     }
     int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() * DB_PEAK_USAGE_FACTOR;
+    // A batch still being written in the background takes memory as well.
+    int64_t flushingSize = pcoinsdbview->FlushingMemoryUsage() * DB_PEAK_USAGE_FACTOR;
     int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
+    // With background flushing the cache and the batch written from it can
+    // both be in memory at once, so the cache gets half the space each time.
+    bool fBackgroundFlush = pcoinsdbview->HasBackgroundFlush();
+    int64_t nCacheSpace = fBackgroundFlush ? nTotalSpace / 2 : nTotalSpace;
     // The cache is large and we're within 10% and 200 MiB or 50% and 50MiB of the limit, but we have time now (not in the middle of a block processing).
-    bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::min(std::max(nTotalSpace / 2, nTotalSpace - MIN_BLOCK_COINSDB_USAGE * 1024 * 1024),
-                                                                            std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024));
+    bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::min(std::max(nCacheSpace / 2, nCacheSpace - MIN_BLOCK_COINSDB_USAGE * 1024 * 1024),
+                                                                            std::max((9 * nCacheSpace) / 10, nCacheSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024));
+    // Don't queue up behind a batch that is still being written unless we have to.
+    if (fBackgroundFlush && pcoinsdbview->IsFlushing())
+        fCacheLarge = false;
     // The cache is over the limit, we have to write now.
-    bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nTotalSpace;
+    bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize + flushingSize > nTotalSpace;
     // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
     bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
     // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
@@ -2171,15 +2654,21 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
     if (fDoFullFlush) {
-        // Typical CCoins structures on disk are around 128 bytes in size.
+        // Typical Coin structures on disk are around 48 bytes in size.
         // Pushing a new one to the database can cause it to be written
         // twice (once in the log, and once in the tables). This is already
         // an overestimation, as most will delete an existing entry or
         // overwrite one. Still, use a conservative safety factor of 2.
-        if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
+        if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
-        // Flush the chainstate (which may refer to block index entries).
-        if (!pcoinsTip->Flush())
+        // Flush the chainstate (which may refer to block index entries),
+        // keeping the recently used part of the cache warm for the next blocks.
+        size_t nKeepUsage = nCacheSpace / 100 * nCoinCacheKeep / DB_PEAK_USAGE_FACTOR;
+        if (!pcoinsTip->FlushPartial(nKeepUsage))
+            return AbortNode(state, "Failed to write to coin database");
+        // Callers of FLUSH_STATE_ALWAYS expect the chainstate to be on disk
+        // afterwards, and pruning must not get ahead of it.
+        if ((mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && !pcoinsdbview->SyncFlush())
             return AbortNode(state, "Failed to write to coin database");
         nLastFlush = nNow;
     }
@@ -2283,6 +2772,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
         CCoinsViewCache view(pcoinsTip);
         if (!DisconnectBlock(block, state, pindexDelete, view))
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
+        UpdateUTXOStats(view);
         bool flushed = view.Flush();
         assert(flushed);
     }
@@ -2322,7 +2812,155 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
     return true;
 }
 
+/** Number of blocks the block read-ahead holds in memory ahead of ConnectTip */
+static const size_t BLOCK_READ_AHEAD_WINDOW = 32;
+
+namespace {
+
+/**
+ * Reads the stored blocks on the way from the active tip to the best header
+ * on a thread of its own, ahead of ConnectTip, so that connecting a long run
+ * of them (after a reindex or -loadblock) does not stop for the disk between
+ * blocks. The read blocks are also checked there, leaving fChecked set for
+ * ConnectBlock.
+ */
+class CBlockReadAhead
+{
+private:
+    std::mutex cs;
+    std::condition_variable cond;
+    //! Blocks read and not taken yet, with their hashes, by height
+    std::map<int, std::pair<uint256, std::shared_ptr<const CBlock> > > mapBlocks;
+    //! Height of the block ConnectTip last asked for
+    int nTakenHeight;
+    std::atomic<bool> fStarted;
+    bool fStop;
+    std::thread thread;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    void ThreadRead(const CChainParams& chainparams);
+
+public:
+    CBlockReadAhead() : nTakenHeight(0), fStarted(false), fStop(false), nHits(0), nMisses(0) {}
+
+    void Start(const CChainParams& chainparams);
+    void Stop();
+    //! The block of pindex if it was read ahead, NULL otherwise
+    std::shared_ptr<const CBlock> Take(const CBlockIndex* pindex);
+};
+
+}
+
+static CBlockReadAhead blockReadAhead;
+
+void CBlockReadAhead::ThreadRead(const CChainParams& chainparams)
+{
+    int nNextHeight = 0;
+    while (true) {
+        size_t nRoom;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            cond.wait(lock, [this]{ return fStop || mapBlocks.size() < BLOCK_READ_AHEAD_WINDOW; });
+            if (fStop)
+                return;
+            nRoom = BLOCK_READ_AHEAD_WINDOW - mapBlocks.size();
+            nNextHeight = std::max(nNextHeight, nTakenHeight + 1);
+        }
+
+        // Where the next blocks towards the best header are stored
+        std::vector<std::pair<const CBlockIndex*, CDiskBlockPos> > vNext;
+        {
+            LOCK(cs_main);
+            nNextHeight = std::max(nNextHeight, chainActive.Height() + 1);
+            for (int nHeight = nNextHeight; pindexBestHeader && nHeight <= pindexBestHeader->nHeight && vNext.size() < nRoom; nHeight++) {
+                const CBlockIndex* pindex = pindexBestHeader->GetAncestor(nHeight);
+                if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                    break;
+                vNext.push_back(std::make_pair(pindex, pindex->GetBlockPos()));
+            }
+        }
+        // ConnectTip reads whatever it needs beyond the stored blocks itself
+        if (vNext.empty())
+            return;
+
+        for (const std::pair<const CBlockIndex*, CDiskBlockPos>& next : vNext) {
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            if (!ReadBlockFromDisk(*pblock, next.second, chainparams.GetConsensus(next.first->nHeight)) || pblock->GetHash() != next.first->GetBlockHash())
+                return;
+            CValidationState state;
+            CheckBlock(*pblock, state);
+
+            std::lock_guard<std::mutex> lock(cs);
+            if (fStop)
+                return;
+            if (next.first->nHeight > nTakenHeight)
+                mapBlocks[next.first->nHeight] = std::make_pair(next.first->GetBlockHash(), pblock);
+            nNextHeight = next.first->nHeight + 1;
+        }
+    }
+}
+
+void CBlockReadAhead::Start(const CChainParams& chainparams)
+{
+    assert(!fStarted);
+    fStop = false;
+    nTakenHeight = 0;
+    nHits = nMisses = 0;
+    fStarted = true;
+    thread = std::thread(&TraceThread<std::function<void()> >, "readahead", std::function<void()>(std::bind(&CBlockReadAhead::ThreadRead, this, std::cref(chainparams))));
+}
+
+void CBlockReadAhead::Stop()
+{
+    if (!fStarted)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+    }
+    cond.notify_all();
+    thread.join();
+    fStarted = false;
+
+    std::lock_guard<std::mutex> lock(cs);
+    if (nHits + nMisses > 0)
+        LogPrintf("Block read-ahead: %u of %u blocks connected were read ahead\n", nHits, nHits + nMisses);
+    mapBlocks.clear();
+}
+
+std::shared_ptr<const CBlock> CBlockReadAhead::Take(const CBlockIndex* pindex)
+{
+    if (!fStarted)
+        return NULL;
+    std::shared_ptr<const CBlock> pblock;
+    std::lock_guard<std::mutex> lock(cs);
+    nTakenHeight = pindex->nHeight;
+    std::map<int, std::pair<uint256, std::shared_ptr<const CBlock> > >::iterator it = mapBlocks.find(pindex->nHeight);
+    if (it != mapBlocks.end() && it->second.first == pindex->GetBlockHash())
+        pblock = it->second.second;
+    // Blocks at or below the tip being connected are of no further use
+    mapBlocks.erase(mapBlocks.begin(), mapBlocks.upper_bound(pindex->nHeight));
+    if (pblock)
+        nHits++;
+    else
+        nMisses++;
+    cond.notify_all();
+    return pblock;
+}
+
+void StartBlockReadAhead(const CChainParams& chainparams)
+{
+    blockReadAhead.Start(chainparams);
+}
+
+void StopBlockReadAhead()
+{
+    blockReadAhead.Stop();
+}
+
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2349,7 +2987,12 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     assert(pindexNew->pprev == chainActive.Tip());
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
-    if (!pblock) {
+    std::shared_ptr<const CBlock> pblockReadAhead;
+    if (!pblock)
+        pblockReadAhead = blockReadAhead.Take(pindexNew);
+    if (pblockReadAhead) {
+        connectTrace.blocksConnected.emplace_back(pindexNew, pblockReadAhead);
+    } else if (!pblock) {
         std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
         connectTrace.blocksConnected.emplace_back(pindexNew, pblockNew);
         if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus(pindexNew->nHeight)))
@@ -2362,6 +3005,10 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    PrefetchBlockInputs(blockConnecting);
+    int64_t nTimePrefetched = GetTimeMicros(); nTimePrefetch += nTimePrefetched - nTime2;
+    LogPrint("bench", "  - Prefetch inputs: %.2fms [%.2fs]\n", (nTimePrefetched - nTime2) * 0.001, nTimePrefetch * 0.000001);
+    nTime2 = nTimePrefetched;
     {
         CCoinsViewCache view(pcoinsTip);
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
@@ -2373,6 +3020,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         }
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
+        UpdateUTXOStats(view);
         bool flushed = view.Flush();
         assert(flushed);
     }
@@ -2795,8 +3443,7 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = new (blockIndexPool.Allocate(sizeof(CBlockIndex), alignof(CBlockIndex))) CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -2967,7 +3614,7 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
 
     //LogPrintf("Block ChainId: %d nVersion %d ", block.GetChainId(), block.GetBaseVersion());
 
-    if (fCheckPOW && !CheckAuxPowProofOfWork(block, Params().GetConsensus(0)))
+    if (fCheckPOW && !CheckAuxPowProofOfWorkCached(block, Params().GetConsensus(0)))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
     return true;
@@ -3255,7 +3902,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, const CB
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW = true)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3274,7 +3921,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state))
+        if (!CheckBlockHeader(block, state, fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3313,6 +3960,10 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
     if (pindex == NULL)
         pindex = AddToBlockIndex(block);
 
+    // CDiskBlockIndex does not keep the auxpow, so remember it for serving headers
+    if (block.auxpow)
+        auxpowHeaderCache.Insert(hash, *block.auxpow);
+
     if (ppindex)
         *ppindex = pindex;
 
@@ -3321,14 +3972,54 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
     return true;
 }
 
+/**
+ * Check the proof of work of all headers not yet in mapBlockIndex on the
+ * PoW checking threads, without holding cs_main.  Scrypt dominates header
+ * validation during initial sync, so this keeps it off the cs_main path.
+ * Returns true only if every new header passed; on false the caller has to
+ * check the headers one by one to find the offending one.
+ */
+static bool CheckHeadersProofOfWork(const std::vector<CBlockHeader>& headers, const CChainParams& chainparams)
+{
+    if (nScriptCheckThreads == 0 || headers.size() < 2)
+        return false;
+
+    // Same (context-free) parameters as used by CheckBlockHeader()
+    const Consensus::Params& params = chainparams.GetConsensus(0);
+    std::vector<const CBlockHeader*> vpNew;
+    vpNew.reserve(headers.size());
+    {
+        LOCK(cs_main);
+        for (const CBlockHeader& header : headers) {
+            if (!mapBlockIndex.count(header.GetHash()))
+                vpNew.push_back(&header);
+        }
+    }
+    if (vpNew.empty())
+        return true;
+
+    // Give every thread work, in groups no larger than the scrypt lane count
+    const size_t nGroupSize = std::max<size_t>(1, std::min<size_t>(SCRYPT_MAX_LANES, (vpNew.size() + nScriptCheckThreads - 1) / nScriptCheckThreads));
+    std::vector<CPowCheck> vChecks;
+    for (size_t i = 0; i < vpNew.size(); i += nGroupSize) {
+        std::vector<const CBlockHeader*> vpGroup(vpNew.begin() + i, vpNew.begin() + std::min(i + nGroupSize, vpNew.size()));
+        vChecks.push_back(CPowCheck(vpGroup, params));
+    }
+
+    CCheckQueueControl<CPowCheck> control(&powcheckqueue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
 {
+    const bool fPowChecked = CheckHeadersProofOfWork(headers, chainparams);
     {
         LOCK(cs_main);
         for (const CBlockHeader& header : headers) {
             CBlockIndex *pindex = NULL; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            if (!AcceptBlockHeader(header, state, chainparams, &pindex, !fPowChecked)) {
                 return false;
             }
             if (ppindex) {
@@ -3545,6 +4236,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        blockFileMaps.Erase(*it);
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3686,9 +4378,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error(std::string(__func__) + ": new CBlockIndex failed");
+    CBlockIndex* pindexNew = new (blockIndexPool.Allocate(sizeof(CBlockIndex), alignof(CBlockIndex))) CBlockIndex();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -3697,24 +4387,30 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
 
 bool static LoadBlockIndexDB(const CChainParams& chainparams)
 {
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
+    int64_t nStart = GetTimeMillis();
+    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex, GetNumCores()))
         return false;
+    LogPrintf("%s: loaded %u block index entries in %dms\n", __func__, mapBlockIndex.size(), GetTimeMillis() - nStart);
 
     boost::this_thread::interruption_point();
 
-    // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
+    // Order by height; heights are dense, so count them instead of sorting
+    int nMaxHeight = 0;
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        nMaxHeight = std::max(nMaxHeight, item.second->nHeight);
+    std::vector<size_t> vHeightStart(nMaxHeight + 2, 0);
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        vHeightStart[item.second->nHeight + 1]++;
+    for (int nHeight = 0; nHeight <= nMaxHeight; nHeight++)
+        vHeightStart[nHeight + 1] += vHeightStart[nHeight];
+    std::vector<CBlockIndex*> vSortedByHeight(mapBlockIndex.size());
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        vSortedByHeight[vHeightStart[item.second->nHeight]++] = item.second;
+
+    // Calculate nChainWork (each entry was loaded with the work of its block alone)
+    BOOST_FOREACH(CBlockIndex* pindex, vSortedByHeight)
     {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
-    }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
-    {
-        CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + pindex->nChainWork;
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
@@ -4021,9 +4717,12 @@ void UnloadBlockIndex()
     }
 
     BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
+        entry.second->~CBlockIndex();
+        blockIndexPool.Deallocate(entry.second);
     }
     mapBlockIndex.clear();
+    auxpowHeaderCache.Clear();
+    blockFileMaps.Clear();
     fHavePruned = false;
 }
 
@@ -4073,13 +4772,16 @@ bool InitBlockIndex(const CChainParams& chainparams)
     return true;
 }
 
-bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
-{
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+// Map of disk positions for blocks with unknown parent (only used for reindex)
+static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
 
-    int nLoaded = 0;
+/**
+ * Locate and deserialize the blocks in fileIn in file order, passing each
+ * with its serialized size to fn, which returns false to stop the scan.
+ * If dbp is non-NULL its nPos is set to the position of each block first.
+ */
+static void ScanExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos* dbp, const std::function<bool(const std::shared_ptr<CBlock>&, unsigned int)>& fn)
+{
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
@@ -4115,79 +4817,280 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 blkdat.SetLimit(nBlockPos + nSize);
                 blkdat.SetPos(nBlockPos);
                 std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
+                blkdat >> *pblock;
                 nRewind = blkdat.GetPos();
 
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus(0).hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
+                if (!fn(pblock, nSize))
+                    break;
+            } catch (const std::exception& e) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+            }
+        }
+    } catch (const std::runtime_error& e) {
+        AbortNode(std::string("System error: ") + e.what());
+    }
+}
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (AcceptBlock(pblock, state, chainparams, NULL, true, dbp, NULL))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus(0).hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+/**
+ * Accept a block read from a block file (found at dbp, if non-NULL), followed
+ * by the blocks read earlier that were waiting for it as their parent.
+ * Returns false if the rest of the file should not be processed.
+ */
+static bool ProcessExternalBlock(const CChainParams& chainparams, const std::shared_ptr<CBlock>& pblock, const CDiskBlockPos* dbp, int& nLoaded)
+{
+    const CBlock& block = *pblock;
+
+    // detect out of order blocks, and store them for later
+    uint256 hash = block.GetHash();
+    if (hash != chainparams.GetConsensus(0).hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+        LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                block.hashPrevBlock.ToString());
+        if (dbp)
+            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+        LOCK(cs_main);
+        CValidationState state;
+        if (AcceptBlock(pblock, state, chainparams, NULL, true, dbp, NULL))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != chainparams.GetConsensus(0).hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+        LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+    }
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == chainparams.GetConsensus(0).hashGenesisBlock) {
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip();
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+            std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+            // TODO: Need a valid consensus height
+            if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus(0)))
+            {
+                LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                        head.ToString());
+                LOCK(cs_main);
+                CValidationState dummy;
+                if (AcceptBlock(pblockrecursive, dummy, chainparams, NULL, true, &it->second, NULL))
+                {
+                    nLoaded++;
+                    queue.push_back(pblockrecursive->GetHash());
                 }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+            NotifyHeaderTip();
+        }
+    }
+    return true;
+}
+
+bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
+{
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    ScanExternalBlockFile(chainparams, fileIn, dbp, [&](const std::shared_ptr<CBlock>& pblock, unsigned int nSize) {
+        return ProcessExternalBlock(chainparams, pblock, dbp, nLoaded);
+    });
+    if (nLoaded > 0)
+        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    return nLoaded > 0;
+}
+
+/** Serialized size of the scanned blocks a reindex may hold in memory ahead of accepting them */
+static const uint64_t MAX_REINDEX_QUEUED_BYTES = 64 << 20;
+
+namespace {
+
+/** A block found by a reindex scanning thread */
+struct CReindexBlock
+{
+    std::shared_ptr<CBlock> pblock;
+    CDiskBlockPos pos;
+    unsigned int nSize;
+};
+
+/** Blocks of one block file, scanned and waiting to be accepted in file order */
+struct CReindexFile
+{
+    std::deque<CReindexBlock> blocks;
+    bool fOpened;
+    bool fScanned;
+
+    CReindexFile() : fOpened(false), fScanned(false) {}
+};
+
+/** State shared by the reindex scanning threads and the thread accepting their blocks */
+struct CReindexQueue
+{
+    std::mutex cs;
+    std::condition_variable cond;
+    std::vector<CReindexFile> vFiles;
+    //! Next file to be claimed by a scanning thread
+    int nNextScan;
+    //! File whose blocks are being accepted
+    int nAccepting;
+    //! Serialized size of all blocks scanned and not accepted yet
+    uint64_t nQueuedBytes;
+    bool fStop;
+
+    explicit CReindexQueue(int nFiles) : vFiles(nFiles), nNextScan(0), nAccepting(0), nQueuedBytes(0), fStop(false) {}
+};
+
+}
+
+/**
+ * Scan block files claimed in order from the queue, running the context-free
+ * block checks (merkle root and proof of work, the bulk of accepting a block
+ * during reindex) so that AcceptBlock finds them done.
+ */
+static void ThreadReindexScan(const CChainParams& chainparams, CReindexQueue& queue)
+{
+    while (true) {
+        int nFile;
+        {
+            std::lock_guard<std::mutex> lock(queue.cs);
+            if (queue.fStop || queue.nNextScan == (int)queue.vFiles.size())
+                return;
+            nFile = queue.nNextScan++;
+        }
+
+        CDiskBlockPos pos(nFile, 0);
+        FILE* file = OpenBlockFile(pos, true);
+        if (file) {
+            {
+                std::lock_guard<std::mutex> lock(queue.cs);
+                queue.vFiles[nFile].fOpened = true;
+            }
+            ScanExternalBlockFile(chainparams, file, &pos, [&](const std::shared_ptr<CBlock>& pblock, unsigned int nSize) {
+                CValidationState state;
+                CheckBlock(*pblock, state);
+
+                // The file being accepted is never held back, so a full queue always drains
+                std::unique_lock<std::mutex> lock(queue.cs);
+                queue.cond.wait(lock, [&]{ return queue.fStop || nFile == queue.nAccepting || queue.nQueuedBytes < MAX_REINDEX_QUEUED_BYTES; });
+                if (queue.fStop)
+                    return false;
+                CReindexBlock block = {pblock, pos, nSize};
+                queue.vFiles[nFile].blocks.push_back(block);
+                queue.nQueuedBytes += nSize;
+                queue.cond.notify_all();
+                return true;
+            });
+        }
+
+        std::lock_guard<std::mutex> lock(queue.cs);
+        queue.vFiles[nFile].fScanned = true;
+        queue.cond.notify_all();
+    }
+}
+
+bool ReindexBlockFiles(const CChainParams& chainparams)
+{
+    int nFiles = 0;
+    while (boost::filesystem::exists(GetBlockPosFilename(CDiskBlockPos(nFiles, 0), "blk")))
+        nFiles++;
+    if (nFiles == 0)
+        return false;
+
+    CReindexQueue queue(nFiles);
+    std::vector<std::thread> vThreads;
+    const int nThreads = std::max(1, std::min(nScriptCheckThreads, nFiles));
+    for (int i = 0; i < nThreads; i++)
+        vThreads.emplace_back(&TraceThread<std::function<void()> >, "reindex", std::function<void()>(std::bind(&ThreadReindexScan, std::cref(chainparams), std::ref(queue))));
+    std::function<void()> stopThreads = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(queue.cs);
+            queue.fStop = true;
+        }
+        queue.cond.notify_all();
+        for (std::thread& thread : vThreads)
+            thread.join();
+    };
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus(0).hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
+    int64_t nStart = GetTimeMillis();
+    int nReindexed = 0, nLoaded = 0, nBlocks = 0;
+    uint64_t nBytes = 0;
+    try {
+        for (int nFile = 0; nFile < nFiles; nFile++) {
+            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+            int64_t nFileStart = GetTimeMicros();
+            int64_t nWaited = 0;
+            int nFileLoaded = 0, nFileBlocks = 0;
+            uint64_t nFileBytes = 0;
+            bool fOpened = false;
+            bool fProcess = true;
+            while (true) {
+                boost::this_thread::interruption_point();
+                CReindexBlock block;
+                {
+                    int64_t nWaitStart = GetTimeMicros();
+                    std::unique_lock<std::mutex> lock(queue.cs);
+                    CReindexFile& file = queue.vFiles[nFile];
+                    queue.cond.wait(lock, [&]{ return !file.blocks.empty() || file.fScanned; });
+                    nWaited += GetTimeMicros() - nWaitStart;
+                    if (file.blocks.empty()) {
+                        fOpened = file.fOpened;
+                        queue.nAccepting = nFile + 1;
+                        queue.cond.notify_all();
                         break;
                     }
+                    block = file.blocks.front();
+                    file.blocks.pop_front();
+                    queue.nQueuedBytes -= block.nSize;
+                    queue.cond.notify_all();
                 }
-
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        // TODO: Need a valid consensus height
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus(0)))
-                        {
-                            LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (AcceptBlock(pblockrecursive, dummy, chainparams, NULL, true, &it->second, NULL))
-                            {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
+                nFileBlocks++;
+                nFileBytes += block.nSize;
+                if (!fProcess)
+                    continue;
+                try {
+                    fProcess = ProcessExternalBlock(chainparams, block.pblock, &block.pos, nFileLoaded);
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+            if (!fOpened)
+                break; // This error is logged in OpenBlockFile
+
+            int64_t nFileTime = GetTimeMicros() - nFileStart;
+            LogPrintf("Reindexed blk%05u.dat: %d blocks (%d new), %.1f MiB in %.2fs (%.1f MiB/s), %.2fs waiting for the scan\n",
+                      (unsigned int)nFile, nFileBlocks, nFileLoaded, nFileBytes * (1.0 / 1024 / 1024), nFileTime * 0.000001,
+                      nFileBytes * (1.0 / 1024 / 1024) / std::max(nFileTime * 0.000001, 0.001), nWaited * 0.000001);
+            nReindexed++;
+            nLoaded += nFileLoaded;
+            nBlocks += nFileBlocks;
+            nBytes += nFileBytes;
         }
-    } catch (const std::runtime_error& e) {
-        AbortNode(std::string("System error: ") + e.what());
+    } catch (...) {
+        stopThreads();
+        throw;
     }
-    if (nLoaded > 0)
-        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    stopThreads();
+
+    int64_t nTime = GetTimeMillis() - nStart;
+    LogPrintf("Reindexed %d block files with %d scanning threads: %d blocks (%d new), %.1f MiB in %.1fs (%.1f MiB/s)\n",
+              nReindexed, nThreads, nBlocks, nLoaded, nBytes * (1.0 / 1024 / 1024), nTime * 0.001,
+              nBytes * (1.0 / 1024 / 1024) / std::max(nTime * 0.001, 0.001));
     return nLoaded > 0;
 }
 
@@ -4400,6 +5303,8 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
 }
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/** Number of transactions from mempool.dat given to AcceptToMemoryPoolBatch at once */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
 
 bool LoadMempool(void)
 {
@@ -4425,30 +5330,42 @@ bool LoadMempool(void)
         uint64_t num;
         file >> num;
         double prioritydummy = 0;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), tx->GetHash().ToString(), prioritydummy, amountdelta);
-            }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(mempool, state, tx, true, NULL, nTime);
-                if (state.IsValid()) {
-                    ++count;
+        std::vector<CTransactionRef> vtx;
+        std::vector<int64_t> vAcceptTime;
+        while (num) {
+            // Read a batch of transactions, then accept them together
+            vtx.clear();
+            vAcceptTime.clear();
+            while (num && vtx.size() < MEMPOOL_LOAD_BATCH_SIZE) {
+                num--;
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                file >> tx;
+                file >> nTime;
+                file >> nFeeDelta;
+
+                CAmount amountdelta = nFeeDelta;
+                if (amountdelta) {
+                    mempool.PrioritiseTransaction(tx->GetHash(), tx->GetHash().ToString(), prioritydummy, amountdelta);
+                }
+                if (nTime + nExpiryTimeout > nNow) {
+                    vtx.push_back(tx);
+                    vAcceptTime.push_back(nTime);
                 } else {
-                    ++failed;
+                    ++skipped;
                 }
-            } else {
-                ++skipped;
             }
+
+            std::vector<CValidationState> vState;
+            std::vector<bool> vAccepted;
+            unsigned int nAccepted;
+            {
+                LOCK(cs_main);
+                nAccepted = AcceptToMemoryPoolBatch(mempool, vtx, vState, vAccepted, true, NULL, &vAcceptTime);
+            }
+            count += nAccepted;
+            failed += vtx.size() - nAccepted;
             if (ShutdownRequested())
                 return false;
         }
@@ -18,6 +18,7 @@
 #include "policy/policy.h" // For RECOMMENDED_MIN_TX_FEE
 #include "protocol.h" // For CMessageHeader::MessageStartChars
 #include "script/script_error.h"
+#include "support/allocators/pool.h"
 #include "sync.h"
 #include "versionbits.h"
 
@@ -37,6 +38,7 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewDB;
 class CBloomFilter;
 class CChainParams;
 class CInv;
@@ -90,6 +92,10 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Minimum number of inputs for mempool admission to spread a transaction's script checks over the script-checking threads */
+static const unsigned int MIN_PARALLEL_MEMPOOL_SCRIPT_CHECKS = 2;
+/** Minimum number of a block's inputs missing from the coins cache to read them on the prefetch threads */
+static const unsigned int MIN_COINS_PREFETCH = 16;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -142,6 +148,10 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+/** Default for -utxostatsindex */
+static const bool DEFAULT_UTXOSTATSINDEX = false;
+/** Default for -blockstatsindex */
+static const bool DEFAULT_BLOCKSTATSINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 /** Default for -mempoolreplacement */
@@ -165,7 +175,8 @@ struct BlockHasher
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
-typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
+//! Nodes of mapBlockIndex are pooled like its CBlockIndex entries, as the map only grows
+typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher, std::equal_to<uint256>, PoolAllocator<std::pair<const uint256, CBlockIndex*> > > BlockMap;
 extern BlockMap mapBlockIndex;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
@@ -177,11 +188,14 @@ extern std::atomic_bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fBlockStatsIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+/** Percentage of the coins cache space kept cached after writing it to disk */
+extern int nCoinCacheKeep;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 //mlumin 5/2021: changing variable name to Rate vs Fee because thats what it is.
 extern CFeeRate minRelayTxFeeRate;
@@ -266,6 +280,14 @@ FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = NULL);
+/**
+ * Import the blocks of all block files for -reindex. The files are scanned and
+ * their blocks checked on parallel threads, and accepted in file order.
+ */
+bool ReindexBlockFiles(const CChainParams& chainparams);
+/** Start reading the stored blocks ActivateBestChain is about to connect ahead of it */
+void StartBlockReadAhead(const CChainParams& chainparams);
+void StopBlockReadAhead();
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk */
@@ -274,6 +296,18 @@ bool LoadBlockIndex(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header proof-of-work checking thread */
+void ThreadPowCheck();
+/** Run an instance of the thread checking scripts of transaction batches for the mempool */
+void ThreadMempoolScriptCheck();
+/** Run an instance of the thread reading block inputs from the coin database ahead of ConnectBlock */
+void ThreadCoinsPrefetch();
+/** Start keeping running UTXO set statistics (-utxostatsindex) from a snapshot of the coin database */
+void InitUTXOStatsIndex();
+/** Run the thread seeding the running UTXO set statistics from the snapshot */
+void ThreadUTXOStatsIndex();
+/** Get the running UTXO set statistics of the tip. Returns false if they are not (yet) available. */
+bool GetUTXOStatsIncremental(CCoinsStats &stats);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -342,6 +376,16 @@ bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced = NULL,
                         bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
 
+/** (try to) add a batch of transactions to memory pool
+ * Transactions are accepted as by AcceptToMemoryPoolWithTime, but after
+ * their parents within the batch, and their scripts are checked in parallel
+ * up front. Results are returned in the order of vtx; pvAcceptTime defaults
+ * to the current time. Returns the number of transactions accepted. **/
+unsigned int AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx, std::vector<CValidationState>& vState,
+                        std::vector<bool>& vAccepted, bool fLimitFree, std::vector<bool>* pvMissingInputs = NULL,
+                        const std::vector<int64_t>* pvAcceptTime = NULL, std::list<CTransactionRef>* plTxnReplaced = NULL,
+                        const CAmount nAbsurdFee=0);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -460,8 +504,8 @@ private:
 
 public:
     CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
-        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey), amount(txFromIn.vout[txToIn.vin[nInIn].prevout.n].nValue),
+    CScriptCheck(const CScript& scriptPubKeyIn, const CAmount amountIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
+        scriptPubKey(scriptPubKeyIn), amount(amountIn),
         ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
 
     bool operator()();
@@ -480,12 +524,91 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the proof-of-work check of a group of block headers,
+ * whose scrypt hashes are computed together by scrypt_1024_1_1_256_multi()
+ * Note that this stores references to the headers and consensus parameters
+ */
+class CPowCheck
+{
+private:
+    std::vector<const CBlockHeader*> vpheaders;
+    const Consensus::Params *pparams;
+
+public:
+    CPowCheck(): pparams(NULL) {}
+    CPowCheck(const std::vector<const CBlockHeader*>& vpheadersIn, const Consensus::Params& paramsIn) :
+        vpheaders(vpheadersIn), pparams(&paramsIn) { }
+
+    bool operator()();
+
+    void swap(CPowCheck &check) {
+        vpheaders.swap(check.vpheaders);
+        std::swap(pparams, check.pparams);
+    }
+};
+
+
+/**
+ * Closure running the script checks of one transaction given to
+ * AcceptToMemoryPoolBatch, only to fill the signature cache. It always
+ * succeeds, as AcceptToMemoryPool reports failures when it checks the
+ * transaction itself.
+ */
+class CMempoolScriptCheck
+{
+private:
+    std::vector<CScriptCheck> vChecks;
+
+public:
+    CMempoolScriptCheck() {}
+    explicit CMempoolScriptCheck(std::vector<CScriptCheck>& vChecksIn) { vChecks.swap(vChecksIn); }
+
+    bool operator()();
+
+    void swap(CMempoolScriptCheck &check) {
+        vChecks.swap(check.vChecks);
+    }
+};
+
+/**
+ * Closure reading one coin from the coin database into a slot owned by the
+ * caller, to warm pcoinsTip before a block is connected. It always
+ * succeeds; a coin that is missing or cannot be read is left spent, and
+ * connecting the block looks it up again.
+ */
+class CCoinsPrefetch
+{
+private:
+    COutPoint outpoint;
+    Coin* pcoin;
+
+public:
+    CCoinsPrefetch(): pcoin(NULL) {}
+    CCoinsPrefetch(const COutPoint& outpointIn, Coin* pcoinIn) : outpoint(outpointIn), pcoin(pcoinIn) { }
+
+    bool operator()();
+
+    void swap(CCoinsPrefetch &check) {
+        std::swap(outpoint, check.outpoint);
+        std::swap(pcoin, check.pcoin);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW = true);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fCheckPOW = true);
+bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW = true);
 bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fCheckPOW = true);
+/** Read the block stored at pos as it is serialized on disk, without deserializing it */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
+/** Hash of a block read with ReadRawBlockFromDisk, taken from its header alone (null if it has none) */
+uint256 GetRawBlockHash(const std::vector<unsigned char>& vchBlock);
+/** Whether the stored block of pindex is what serializing it with nSerFlags (such as SERIALIZE_TRANSACTION_NO_WITNESS) gives */
+bool IsStoredBlockSerialization(const CBlockIndex* pindex, int nSerFlags);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -552,6 +675,9 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Global variable that points to the coin database backing pcoinsTip */
+extern CCoinsViewDB *pcoinsdbview;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
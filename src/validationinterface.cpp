@@ -40,6 +40,8 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock,
                                                    pwalletIn, boost::placeholders::_1,
                                                    boost::placeholders::_2));
+    g_signals.NewAuxBlock.connect(boost::bind(&CValidationInterface::NewAuxBlock,
+                                              pwalletIn, boost::placeholders::_1));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
@@ -68,6 +70,8 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock,
                                           pwalletIn, boost::placeholders::_1,
                                           boost::placeholders::_2));
+    g_signals.NewAuxBlock.disconnect(boost::bind(&CValidationInterface::NewAuxBlock,
+                                     pwalletIn, boost::placeholders::_1));
 }
 
 void UnregisterAllValidationInterfaces() {
@@ -80,4 +84,5 @@ void UnregisterAllValidationInterfaces() {
     g_signals.SyncTransaction.disconnect_all_slots();
     g_signals.UpdatedBlockTip.disconnect_all_slots();
     g_signals.NewPoWValidBlock.disconnect_all_slots();
+    g_signals.NewAuxBlock.disconnect_all_slots();
 }
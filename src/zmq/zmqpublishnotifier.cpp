@@ -3,7 +3,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "arith_uint256.h"
 #include "chainparams.h"
+#include "crypto/common.h"
 #include "streams.h"
 #include "zmqpublishnotifier.h"
 #include "validation.h"
@@ -16,6 +18,7 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_AUXBLOCK  = "auxblock";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -195,3 +198,18 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishAuxBlockNotifier::NotifyAuxBlock(const CBlock &block)
+{
+    uint256 hash = block.GetHash();
+    LogPrint("zmq", "zmq: Publish auxblock %s\n", hash.GetHex());
+    uint256 target = ArithToUint256(arith_uint256().SetCompact(block.nBits));
+    int32_t nChainId = block.GetChainId();
+    char data[68];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    WriteLE32((unsigned char*)data + 32, nChainId);
+    for (unsigned int i = 0; i < 32; i++)
+        data[67 - i] = target.begin()[i];
+    return SendMessage(MSG_AUXBLOCK, data, 68);
+}
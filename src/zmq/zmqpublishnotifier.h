@@ -52,4 +52,10 @@ public:
     bool NotifyTransaction(const CTransaction &transaction);
 };
 
+class CZMQPublishAuxBlockNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyAuxBlock(const CBlock &block);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H